@@ -9,15 +9,33 @@
 #include "IO.h"
 #include "GenericAAM.h"
 #include "FaceLocaliser.h"
+#include "ModelPCA.h"
+#include "ModelFitter.h"
 
 class AAM2D : public GenericAAM
 {
 private:
 protected:
+  unique_ptr<AAMPCA> aamPCA;
+  FittingCriteria crit;
+  int skipPixels;
+
 public:
-  inline AAM2D(FaceLocaliser* faceDetector) : GenericAAM(faceDetector){};
+  inline AAM2D(FaceLocaliser* faceDetector) 
+    : GenericAAM(faceDetector), crit(FittingCriteria::getDefault()), skipPixels(2) {};
+  inline AAM2D(
+    FaceLocaliser* faceDetector, 
+    unique_ptr<AAMPCA> const& aamPCA, 
+    FittingCriteria const& crit = FittingCriteria::getDefault(),
+    int skipPixels = 2)
+    : GenericAAM(faceDetector), aamPCA(aamPCA->clone()), crit(crit), skipPixels(skipPixels) {};
   virtual inline ~AAM2D(){};
-  void fit(Mat im);
+
+  inline void setModel(unique_ptr<AAMPCA> const& aamPCA) { this->aamPCA = aamPCA->clone(); };
+  inline void setCriteria(FittingCriteria const& crit) { this->crit = crit; };
+
+  FittingCriteria seedFromDetection(const Rect& face) const;
+  vector<unique_ptr<BaseFittedModel>> fit(Mat im);
   void saveToFile(const string& modelFileName) const;
   void loadFromFile(const string& modelFileName);
   void trainFromFileList(const vector<string>& filelist);
@@ -32,4 +50,4 @@ public:
 // };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -6,6 +6,7 @@
 #include "Shape.h"
 #include "MeshShape.h"
 #include "Texture.h"
+#include "MatArena.h"
 
 /**
  * Statistical model of bounded texture
@@ -33,11 +34,13 @@ public:
   unique_ptr<BaseModel> clone() const;
   Mat toRowVector() const;
   Mat toRowVectorReduced(int maxSize) const;
+  void toRowVectorReduced(int maxSize, Mat out) const; // Writes into a preallocated 1 x [maxSize] row
   Mat toColVector() const;
   MeshShape getShape() const { return this->mesh; };
   vector<Texture> getTextures() const { return this->textureList; };
   void setGraphic(const Mat& newGraphic) { newGraphic.copyTo(this->graphic); };
   const Mat& getGraphic() const { return this->graphic; };
+  int channels() const { return this->graphic.channels(); };
   const Size getSize() const { return this->mesh.getBound().size(); };
   const Size getSpannedSize() const { return this->mesh.getSpannedSize(); };
 
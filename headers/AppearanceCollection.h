@@ -12,27 +12,40 @@
 #include "ModelCollection.h"
 #include "ShapeCollection.h"
 #include "ModelPCA.h"
+#include "ReferenceFrame.h"
 
 class AppearanceCollection : public ModelCollection
 {
+protected:
+  PhotometricMode photometricMode = PHOTOMETRIC_OFF; // Normalisation of the vectors fed to the PCA
+
+  PhotometricNormaliser normalisePhotometry(Mat& data) const;
 public:
   inline AppearanceCollection() : ModelCollection() {};
-  AppearanceCollection(const vector<BaseModel*>& models) : ModelCollection(models) {};
-  AppearanceCollection(const vector<Appearance*>& apps);
-  AppearanceCollection(const AppearanceCollection& original);
+  AppearanceCollection(const vector<BaseModel*>& models) : ModelCollection(models) {}; // Takes ownership
+  AppearanceCollection(vector<unique_ptr<BaseModel>>&& models) : ModelCollection(move(models)) {};
+  AppearanceCollection(const vector<Appearance*>& apps); // Takes ownership
+  AppearanceCollection(const AppearanceCollection& original); // Deep copy
+  AppearanceCollection(AppearanceCollection&& original) = default;
 
   // ---------- Analysis -------------
   Mat covariance(const BaseModel* mean) const;
   void normaliseRotation();
   virtual double sumProcrustesDistance(const BaseModel* targetModel) const;
   virtual ModelPCA* pca(const BaseModel* mean, int maxDimension) const;
+  ModelPCA* pca(const ReferenceFrame& frame) const;
+  inline void setPhotometric(PhotometricMode mode) { this->photometricMode = mode; };
+  inline PhotometricMode getPhotometric() const { return this->photometricMode; };
+  int channels() const; // Of the appearances, which all share the same type
   
   // ---------- I/O ------------------
   Mat toMat() const;
   Mat toMatReduced(int maxDimension) const;
+  Mat toMat(const ReferenceFrame& frame) const;
   unique_ptr<ModelCollection> clone() const;
   unique_ptr<ModelCollection> toShapeCollection() const;
   unique_ptr<ModelCollection> resizeTo(double newScale) const;
+  void resize(double newScale); // In place
 };
 
 #endif
\ No newline at end of file
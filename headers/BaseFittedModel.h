@@ -58,10 +58,30 @@ public:
   virtual Appearance* toAppearance() const = 0;
   virtual MeshShape* toShape() const = 0;
   virtual unique_ptr<BaseFittedModel> clone() const = 0;
+
+  /**
+   * Overwrite the variable states with those of [another],
+   * reusing the parameter buffers already allocated.
+   * Both models are expected to share the same AAM.
+   */
+  inline virtual BaseFittedModel* assign(const BaseFittedModel& another)
+  {
+    assert(this->shapeParam.size() == another.shapeParam.size());
+    assert(this->appearanceParam.size() == another.appearanceParam.size());
+    another.shapeParam.copyTo(this->shapeParam);
+    another.appearanceParam.copyTo(this->appearanceParam);
+    this->origin = another.origin;
+    this->scale = another.scale;
+    return this;
+  };
   virtual Rect getBound() const = 0;
   virtual Size getSpannedSize() const = 0;
 
-  virtual double measureError(const Mat& sample, int skipPixels) = 0;
+  virtual double measureError(
+    const Mat& sample, 
+    int skipPixels, 
+    double rejectAbove = numeric_limits<double>::max(),
+    double* blankError = nullptr) = 0;
   virtual Mat drawOverlay(Mat& canvas, bool withEdges = false) = 0;
 };
 
@@ -0,0 +1,68 @@
+/**
+ * Recycling pool of fitted model candidates
+ */
+
+#ifndef CANDIDATE_POOL
+#define CANDIDATE_POOL
+
+#include "master.h"
+#include "BaseFittedModel.h"
+#include "Trace.h"
+
+/**
+ * Free list of [BaseFittedModel] instances for the beam search.
+ * A candidate is acquired as a copy of its parent and released
+ * when it loses, so its object and parameter buffers (sized once by
+ * the AAM dimensions) are reused by the next candidate instead of
+ * going through the allocator.
+ *
+ * NOTE: All models released into a pool must share the same AAM,
+ * so the pool is to be cleared whenever the AAM may change.
+ */
+class CandidatePool
+{
+private:
+  vector<unique_ptr<BaseFittedModel>> items;
+
+  CandidatePool(const CandidatePool& another) = delete;
+
+public:
+  inline CandidatePool() {};
+  virtual inline ~CandidatePool(){};
+
+  /**
+   * Acquire a candidate with the same states as [parent]
+   */
+  inline unique_ptr<BaseFittedModel> acquire(const BaseFittedModel& parent)
+  {
+    if (this->items.empty())
+    {
+      TRACE_COUNT("pool.misses", 1);
+      return parent.clone();
+    }
+    TRACE_COUNT("pool.hits", 1);
+    unique_ptr<BaseFittedModel> m = move(this->items.back());
+    this->items.pop_back();
+    m->assign(parent);
+    return m;
+  };
+
+  inline void release(unique_ptr<BaseFittedModel>& m)
+  {
+    if (m != nullptr) this->items.push_back(move(m));
+  };
+
+  /**
+   * Take back all models of [ms], leaving it empty
+   */
+  inline void release(vector<unique_ptr<BaseFittedModel>>& ms)
+  {
+    for (auto& m : ms) release(m);
+    ms.clear();
+  };
+
+  inline void clear() { this->items.clear(); };
+  inline size_t size() const { return this->items.size(); };
+};
+
+#endif
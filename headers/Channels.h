@@ -0,0 +1,52 @@
+/**
+ * Pixel kernels specialised on the number of channels
+ */
+
+#ifndef CHANNELS
+#define CHANNELS
+
+#include "master.h"
+
+/**
+ * 8-bit pixel of [CN] channels,
+ * a plain byte for grayscale so the kernels do not loop over one channel
+ */
+template<int CN> struct PixelOf { typedef Vec<unsigned char, CN> type; };
+template<> struct PixelOf<1> { typedef unsigned char type; };
+
+template<int CN> inline unsigned char channelOf(const typename PixelOf<CN>::type& p, int c) { return p[c]; };
+template<> inline unsigned char channelOf<1>(const unsigned char& p, int c) { return p; };
+
+template<int CN> inline void setChannel(typename PixelOf<CN>::type& p, int c, unsigned char v) { p[c] = v; };
+template<> inline void setChannel<1>(unsigned char& p, int c, unsigned char v) { p = v; };
+
+/**
+ * Run [Kernel<CN>::run] with the channel count known at compile time.
+ * Models are either grayscale (1) or colour (3).
+ */
+template<template<int> class Kernel, typename... Args>
+inline auto dispatchChannels(int channels, Args&&... args)
+  -> decltype(Kernel<3>::run(std::forward<Args>(args)...))
+{
+  switch (channels)
+  {
+    case 1: return Kernel<1>::run(std::forward<Args>(args)...);
+    case 3: return Kernel<3>::run(std::forward<Args>(args)...);
+    default:
+      throw invalid_argument(fmt::format("Unsupported number of channels : {0}", channels));
+  }
+}
+
+/**
+ * Convert [im] to [channels] channels, or share it when it already matches
+ */
+inline Mat toChannels(const Mat& im, int channels)
+{
+  if (im.channels() == channels) return im;
+  Mat converted;
+  if (channels == 1) cvtColor(im, converted, COLOR_BGR2GRAY);
+  else cvtColor(im, converted, COLOR_GRAY2BGR);
+  return converted;
+}
+
+#endif
@@ -16,13 +16,27 @@ public:
   virtual vector<Rect> find(Mat im) const = 0;
 };
 
+/**
+ * Viola-Jones face detector on top of the OpenCV cascade classifier
+ */
 class HaarBasedFaceLocaliser : public FaceLocaliser
 {
+protected:
+  mutable CascadeClassifier cascade; // detectMultiScale is not const
+  double scaleFactor;
+  int minNeighbours;
+  Size minSize;
+
 public:
-  HaarBasedFaceLocaliser() : FaceLocaliser(){};
+  HaarBasedFaceLocaliser(
+    const string& cascadePath = "haarcascade_frontalface_default.xml",
+    double scaleFactor = 1.1,
+    int minNeighbours = 3,
+    Size minSize = Size(30, 30));
   virtual ~HaarBasedFaceLocaliser() {};
+  inline bool isLoaded() const { return !this->cascade.empty(); };
   virtual vector<Rect> find(Mat im) const;
 };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -9,6 +9,8 @@
 #include "ModelPCA.h"
 #include "ModelFitter.h"
 #include "BaseFittedModel.h"
+#include "MatArena.h"
+#include "Channels.h"
 
 /**
  * State of the active appearance model fitted onto a sample
@@ -27,8 +29,8 @@ public:
   FittedAAM(const FittedAAM& another) : BaseFittedModel(another){};
   virtual ~FittedAAM(){};
 
-  const ShapeModelPCA pcaShape() const { return aamPCA->getShapePCA(); };
-  const AppearanceModelPCA pcaAppearance() const { return aamPCA->getAppearancePCA(); };
+  const ShapeModelPCA& pcaShape() const { return aamPCA->getShapePCA(); };
+  const AppearanceModelPCA& pcaAppearance() const { return aamPCA->getAppearancePCA(); };
   const double getMeanShapeScale() const;
   Rect getBound() const;
   Size getSpannedSize() const;
@@ -42,7 +44,11 @@ public:
   MeshShape* toShape() const;
   unique_ptr<BaseFittedModel> clone() const;
 
-  double measureError(const Mat& sample, int skipPixels=0);
+  double measureError(
+    const Mat& sample, 
+    int skipPixels=0, 
+    double rejectAbove=numeric_limits<double>::max(),
+    double* blankError=nullptr);
   Mat drawOverlay(Mat& canvas, bool withEdges = false);
 };
 
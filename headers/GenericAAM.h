@@ -11,6 +11,7 @@
 #include "FaceLocaliser.h"
 #include "ShapeCollection.h"
 #include "AppearanceCollection.h"
+#include "BaseFittedModel.h"
 
 /**
  * Representative of the trained AAM which is ready to use
@@ -27,7 +28,7 @@ public:
   inline GenericAAM(FaceLocaliser* faceDetector) { this->faceFinder = faceDetector; }
   virtual inline ~GenericAAM() {};
 
-  virtual void fit(Mat im) = 0;
+  virtual vector<unique_ptr<BaseFittedModel>> fit(Mat im) = 0;
   virtual void saveToFile(const string& modelFileName) const = 0;
   virtual void loadFromFile(const string& modelFileName) = 0;
   virtual void trainFromFileList(const vector<string>& filelist) = 0;
@@ -11,8 +11,26 @@ namespace IO
   public:
     virtual ~GenericIO(){}
     virtual void render(const Mat& im) = 0;
+    virtual bool isHeadless() const { return false; };
   };
 
+  /**
+   * Output sink which discards everything.
+   * Rendering functions skip all drawing when given a headless IO.
+   */
+  class NullIO : public GenericIO
+  {
+  public:
+    NullIO(){};
+    inline void render(const Mat& im) {};
+    inline bool isHeadless() const { return true; };
+  };
+
+  inline bool isHeadless(const GenericIO* io)
+  {
+    return io == nullptr || io->isHeadless();
+  }
+
   class FileOutputIO : public GenericIO
   {
   protected:
@@ -0,0 +1,75 @@
+/**
+ * Levelled logging
+ * ------------------------------
+ * Messages above the compile-time [AAM_LOG_LEVEL] are stripped by the compiler,
+ * the remaining ones are filtered by the runtime level (see [Log::setLevel]).
+ *
+ *   AAM_LOG(Debug) << "... Best error so far : " << e;
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <iostream>
+#include <sstream>
+#include <atomic>
+
+// Compile-time ceiling of verbosity
+// 0 = off, 1 = error, 2 = warn, 3 = info, 4 = debug, 5 = verbose
+#ifndef AAM_LOG_LEVEL
+  #ifdef NDEBUG
+    #define AAM_LOG_LEVEL 2
+  #else
+    #define AAM_LOG_LEVEL 5
+  #endif
+#endif
+
+namespace Log
+{
+  enum Level
+  {
+    Off = 0,
+    Error,
+    Warn,
+    Info,
+    Debug,
+    Verbose // Inner loops, expect a flood
+  };
+
+  extern std::atomic<int> runtimeLevel;
+
+  inline void setLevel(Level level) { runtimeLevel.store(level); }
+  inline Level getLevel() { return static_cast<Level>(runtimeLevel.load(std::memory_order_relaxed)); }
+
+  /**
+   * Both operands are constants when the level is above [AAM_LOG_LEVEL],
+   * so the whole logging statement folds away.
+   */
+  inline bool isEnabled(Level level)
+  {
+    return level <= AAM_LOG_LEVEL
+      && level <= runtimeLevel.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * A single log line, buffered then flushed atomically on destruction
+   */
+  class Line
+  {
+  private:
+    Level level;
+    std::ostringstream buffer;
+  public:
+    inline Line(Level level) : level(level) {};
+    ~Line();
+    inline std::ostream& stream() { return this->buffer; };
+  };
+}
+
+// A loop running at most once, unlike a bare if-else it leaves no else
+// to bind, so unbraced `if (...) AAM_LOG(...) << ...;` stays warning-free
+#define AAM_LOG(level) \
+  for (bool aamLogOn = Log::isEnabled(Log::level); aamLogOn; aamLogOn = false) \
+    Log::Line(Log::level).stream()
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * Scratch buffer arena for short-lived matrices
+ */
+
+#ifndef MAT_ARENA
+#define MAT_ARENA
+
+#include "master.h"
+#include "Trace.h"
+
+/**
+ * Per-thread pool of raw buffers which hands out [Mat] headers
+ * over pre-allocated memory. Buffers are reclaimed in bulk when
+ * the enclosing [MatArena::Scope] ends, so a steady-state loop
+ * stops hitting the heap once the pool has grown to its peak size.
+ *
+ * NOTE: A matrix acquired from the arena must not outlive its scope.
+ *       Clone it if the data has to be kept.
+ */
+class MatArena
+{
+private:
+  vector<Mat> buffers; // Raw byte blocks, grown on demand
+  size_t cursor;
+
+  MatArena(const MatArena& another) = delete;
+
+public:
+  /**
+   * Restores the arena cursor on exit,
+   * releasing every buffer acquired within the scope
+   */
+  class Scope
+  {
+  private:
+    MatArena& arena;
+    size_t mark;
+  public:
+    inline Scope(MatArena& a) : arena(a), mark(a.cursor) {};
+    inline ~Scope(){ arena.cursor = mark; };
+  };
+
+  inline MatArena() : cursor(0) {};
+  virtual inline ~MatArena(){};
+
+  /**
+   * Arena dedicated to the calling thread
+   */
+  static inline MatArena& local()
+  {
+    static thread_local MatArena arena;
+    return arena;
+  };
+
+  /**
+   * Acquire an uninitialised matrix backed by a pooled buffer
+   */
+  inline Mat acquire(int rows, int cols, int type)
+  {
+    size_t bytes = (size_t)rows * cols * CV_ELEM_SIZE(type);
+    if (this->cursor == this->buffers.size())
+    {
+      this->buffers.push_back(Mat());
+    }
+    Mat& buffer = this->buffers[this->cursor++];
+    if (buffer.cols < (int)bytes)
+    {
+      // Grow geometrically so a slowly increasing request
+      // does not reallocate on every call
+      TRACE_COUNT("arena.growths", 1);
+      buffer.create(1, (int)max(bytes, (size_t)buffer.cols * 2), CV_8UC1);
+    }
+    return Mat(rows, cols, type, buffer.data);
+  };
+
+  inline Mat acquire(Size size, int type) { return acquire(size.height, size.width, type); };
+
+  inline Mat zeros(int rows, int cols, int type)
+  {
+    Mat m = acquire(rows, cols, type);
+    m.setTo(Scalar::all(0));
+    return m;
+  };
+
+  inline Mat zeros(Size size, int type) { return zeros(size.height, size.width, type); };
+
+  inline size_t numBuffers() const { return this->buffers.size(); };
+  inline size_t inUse() const { return this->cursor; };
+};
+
+#endif
@@ -5,28 +5,39 @@
 #include "BaseModel.h"
 #include "ModelPCA.h"
 
+/**
+ * Owning series of models.
+ * Transformations are applied in place on the owned items,
+ * a copy of the whole series is only made by [clone].
+ */
 class ModelCollection 
 {
 private:
   long long uid;
   static long long generateUID();
 protected:
-  vector<BaseModel*> items;
+  vector<unique_ptr<BaseModel>> items;
   long long getUID() const { return this->uid; };
 public:
   ModelCollection() : uid(ModelCollection::generateUID()) {};
-  ModelCollection(vector<BaseModel*> vs) : uid(ModelCollection::generateUID()), items(vs) {};
+  ModelCollection(const vector<BaseModel*>& vs); // Takes ownership of [vs]
+  ModelCollection(vector<unique_ptr<BaseModel>>&& vs) : uid(ModelCollection::generateUID()), items(move(vs)) {};
+  ModelCollection(ModelCollection&& another) = default;
+  ModelCollection& operator=(ModelCollection&& another) = default;
+  ModelCollection(const ModelCollection& another) = delete;
   virtual ~ModelCollection();
   virtual void clear();
 
-  inline void add(BaseModel* item){ this->items.push_back(item); };
+  inline void add(BaseModel* item){ this->items.emplace_back(item); };
+  inline void add(unique_ptr<BaseModel>&& item){ this->items.push_back(move(item)); };
   virtual unique_ptr<ModelCollection> clone() const = 0;
   virtual Mat toMat() const = 0;
-  inline const vector<BaseModel*> getItems() { return this->items; };
+  const vector<BaseModel*> getItems() const; // Non-owning view
+  inline BaseModel* at(int i) const { return this->items[i].get(); };
   inline int size() const { return this->items.size(); };
 
   // ------- Geometrical Analysis -------------
-  virtual BaseModel* procrustesMean(double tol=1e-3, int maxIter=10);
+  virtual unique_ptr<BaseModel> procrustesMean(double tol=1e-3, int maxIter=10);
   virtual double sumProcrustesDistance(const BaseModel* targetModel) const;
   virtual void normaliseRotation();
   virtual Mat covariance(const BaseModel* mean) const;
@@ -9,18 +9,15 @@
 #include "Appearance.h"
 #include "ModelPCA.h"
 #include "PriorityLinkedList.h"
+#include "MatArena.h"
+#include "Channels.h"
+#include "PerturbationTable.h"
+#include "StepScheduler.h"
+#include "CandidatePool.h"
+#include "Trace.h"
 
 typedef PriorityLinkedList<BaseFittedModel> ModelList;
 
-enum SearchWith
-{
-  SCALING = 0,
-  TRANSLATION,
-  RESHAPING,
-  REAPPEARANCING
-  // TAOTOREVIEW: Rotation?
-};
-
 const double SCALING_MIN = 0.677;
 const double SCALING_MAX = 3;
 const double TRANSLATION_MIN = -250;
@@ -29,6 +26,7 @@ const double RESHAPING_MIN = -50;
 const double RESHAPING_MAX = 50;
 const double REAPPEARANCING_MIN = -50;
 const double REAPPEARANCING_MAX = 50;
+const int ROI_MARGIN = 8; // Pixels around the beam kept inside the search region
 
 struct FittingCriteria
 {
@@ -40,10 +38,19 @@ struct FittingCriteria
   Point2d initPos; // Coordinate of the upper-left origin
   double minScale;
   double maxScale;
+  PerturbationSteps steps;
+  StepPolicy stepPolicy;
+  bool earlyRejection; // Stop measuring a candidate which can't make it into the beam
+  bool combinedSearch; // Search the combined PCA instead of shape & appearance separately
+  bool coarseSearch; // Initialise position and scale with a global template search
+  int coarseScaleSteps; // Number of scales between [minScale] and [maxScale] of the coarse search
 
   static FittingCriteria getDefault()
   {
-    return FittingCriteria{ 10, 16, 8, 1e-4, 100, Point2d(0,0), 0.33, 3 };
+    return FittingCriteria{ 10, 16, 8, 1e-4, 100, Point2d(0,0), 0.33, 3,
+      PerturbationSteps::getDefault(),
+      StepPolicy::getDefault(),
+      true, false, false, 8 };
   };
 };
 
@@ -58,26 +65,39 @@ protected:
   unique_ptr<AAMPCA> aamPCA;
   ModelList models;
   ModelList buffer;
-  Mat sample;
-  Mat zero;
-
+  Mat sample; // Shared with the caller, not copied
+  Rect roi; // Search region of the candidates
+  Mat roiSample; // View of [sample] over [roi]
+  unique_ptr<PerturbationTable> table;
+  StepScheduler scheduler;
+  CandidatePool pool; // Recycled candidates
+  vector<unique_ptr<BaseFittedModel>> dropped; // Scratch list of losing candidates
+
+  // Candidate statistics of the current expansion
+  int numEvaluated;
+  int numAccepted;
+  int numRejectedEarly;
+
+  void evaluateCandidate(unique_ptr<BaseFittedModel>& candidate, double parentError);
   void iterateModelExpansion(
     ModelList* const modelPtr,
     SearchWith action = TRANSLATION,
-    double scale = 1.0);
+    double step = 1.0);
   
   void transferFromBuffer(int nLeft);
+  void coarseSearch(unique_ptr<BaseFittedModel>& model) const;
+  void updateROI();
 
 public:
   inline ModelFitter(
     unique_ptr<AAMPCA> const & aamPCA,
     FittingCriteria const& crit,
     Mat& sample) 
-    : crit(crit)
+    : crit(crit), scheduler(crit.stepPolicy)
     {
       this->aamPCA = aamPCA->clone();
-      sample.copyTo(this->sample);
-      zero = Mat::zeros(sample.size(), CV_8UC3);
+      this->table.reset(new PerturbationTable(*this->aamPCA, crit.steps));
+      setSample(sample);
     };
   
   virtual inline ~ModelFitter()
@@ -85,19 +105,32 @@ public:
     this->aamPCA.reset();
   };
 
+  /**
+   * The sample is shared, it must stay unchanged while fitting.
+   * Model coordinates are relative to the sample itself,
+   * so a view into a larger image is detached.
+   * A sample whose channels differ from the model is converted.
+   */
   void setSample(Mat& sample)
   {
-    sample.copyTo(this->sample);
-    zero = Mat::zeros(sample.size(), CV_8UC3);
+    int channels = this->aamPCA->getAppearancePCA().getChannels();
+    if (sample.channels() != channels) this->sample = toChannels(sample, channels);
+    else this->sample = sample.isSubmatrix() ? sample.clone() : sample;
+    this->roi = Rect(0, 0, this->sample.cols, this->sample.rows);
+    this->roiSample = this->sample;
   };
 
   void setCriteria(FittingCriteria& crit)
   {
     this->crit = crit;
+    this->table.reset(new PerturbationTable(*this->aamPCA, crit.steps));
+    this->scheduler = StepScheduler(crit.stepPolicy);
   };
 
   const ShapeModelPCA& getShapePCA() const { return aamPCA->getShapePCA(); };
   const AppearanceModelPCA& getAppearancePCA() const { return aamPCA->getAppearancePCA(); };
+  const StepScheduler& getScheduler() const { return scheduler; };
+  const Rect& getROI() const { return roi; };
 
   virtual unique_ptr<BaseFittedModel> fit(unique_ptr<BaseFittedModel>& initModel, int skipPixels);
 };
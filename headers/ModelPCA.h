@@ -5,6 +5,10 @@
 #include "BaseModel.h"
 #include "MeshShape.h"
 #include "Appearance.h"
+#include "ReferenceFrame.h"
+#include "Photometric.h"
+#include "MatArena.h"
+#include "Trace.h"
 
 /**
  * PCA model encoding
@@ -30,11 +34,13 @@ public:
   virtual BaseModel* mean() const = 0;
   virtual BaseModel* toModel(const Mat& param) const = 0;
 
-  // Generate permutation of parameter matrix
-  virtual int getSizeOfPermutationOfParams() const = 0;
-  virtual void permutationOfParams(Mat* out) const = 0;
+  // Generate perturbations of the parameters
+  void generatePerturbations(const vector<double>& steps, bool scaleByEigenvalue, vector<Mat>& out) const;
+  static void generatePerturbations(const PCA& pca, const vector<double>& steps, bool scaleByEigenvalue, vector<Mat>& out);
 
   const int dimension() const { return this->pca.eigenvalues.rows; };
+  const double eigenStd(int i) const { return std::sqrt(max(0.0, this->pca.eigenvalues.at<double>(i))); };
+  const double totalVariance() const { return this->pca.eigenvalues.empty() ? 0 : sum(this->pca.eigenvalues)[0]; };
   Point2d getTranslation() const { return this->translation; };
   double getScale() const { return this->scale; };
   void setTranslation(const Point2d& t) { this->translation = t; };
@@ -50,8 +56,6 @@ public:
   BaseModel* mean() const; 
   BaseModel* toModel(const Mat& param) const;
   MeshShape* toShape(const Mat& param) const;
-  int getSizeOfPermutationOfParams() const;
-  void permutationOfParams(Mat* out) const;
 
   ShapeModelPCA cloneWithNewScale(double newScale, const Point2d& newTranslation) const;
 };
@@ -61,13 +65,21 @@ class AppearanceModelPCA : public ModelPCA
 protected:
   Size originalBound;
   MeshShape meanShape; // TAOTODO: Should enfore meanShape origin at (0,0)
+  int channels; // 1 (grayscale) or 3
+  ReferenceFrame frame; // Empty unless trained on shape-normalised vectors
+  PhotometricNormaliser photometric; // Applied to the vectors before projection
+
 public: 
-  AppearanceModelPCA() : ModelPCA() {};
-  AppearanceModelPCA(const PCA& p, const MeshShape& mean, const Size& size) : ModelPCA(p), originalBound(size) { this->meanShape = mean; };
+  AppearanceModelPCA() : ModelPCA(), channels(3) {};
+  AppearanceModelPCA(const PCA& p, const MeshShape& mean, const Size& size, int channels=3) : ModelPCA(p), originalBound(size), channels(channels) { this->meanShape = mean; };
+  AppearanceModelPCA(const PCA& p, const ReferenceFrame& f) : ModelPCA(p), originalBound(f.getMeanShape().getBound().size()), channels(f.getChannels()), frame(f) { this->meanShape = f.getMeanShape(); };
   AppearanceModelPCA(const AppearanceModelPCA& that) : ModelPCA(that.pca) 
   { 
     originalBound = that.originalBound;
     meanShape = that.meanShape;
+    channels = that.channels;
+    frame = that.frame;
+    photometric = that.photometric;
   };
   BaseModel* mean() const;
   
@@ -75,12 +87,43 @@ public:
   Mat toParam(const BaseModel* m) const;
   BaseModel* toModel(const Mat& param) const;
   Appearance* toAppearance(const Mat& param) const;
-  int getSizeOfPermutationOfParams() const;
-  void permutationOfParams(Mat* out) const;
   
   void overrideMeanShape(const MeshShape& newMeanShape);
   Rect getBound() const;
   const double getMeanShapeScale() const { return this->meanShape.getScale(); };
+  int getChannels() const { return this->channels; };
+  bool hasFrame() const { return !this->frame.empty(); };
+  const ReferenceFrame& getFrame() const { return this->frame; };
+  const PhotometricNormaliser& getPhotometric() const { return this->photometric; };
+  void setPhotometric(const PhotometricNormaliser& p) { this->photometric = p; };
+};
+
+/**
+ * Joint PCA over concatenated shape and appearance parameters (combined AAM).
+ * Shape parameters are weighted so both parts carry comparable variance.
+ */
+class CombinedModelPCA
+{
+protected:
+  PCA pca;
+  double shapeWeight;
+  int shapeDimension;
+  int appearanceDimension;
+
+public:
+  CombinedModelPCA() : shapeWeight(1), shapeDimension(0), appearanceDimension(0) {};
+  CombinedModelPCA(
+    const Mat& shapeParams, 
+    const Mat& appearanceParams, 
+    double shapeWeight, 
+    double retainedVariance);
+  inline virtual ~CombinedModelPCA() {};
+
+  void toShapeAndAppearanceDeltas(const Mat& delta, Mat& shapeDelta, Mat& appearanceDelta) const;
+  void generatePerturbations(const vector<double>& steps, bool scaleByEigenvalue, vector<Mat>& out) const;
+
+  const int dimension() const { return this->pca.eigenvalues.rows; };
+  const double getShapeWeight() const { return this->shapeWeight; };
 };
 
 class AAMPCA 
@@ -88,22 +131,30 @@ class AAMPCA
 protected:
   ShapeModelPCA pcaShape;
   AppearanceModelPCA pcaAppearance;
+  CombinedModelPCA pcaCombined;
 
 public:
   AAMPCA(const ShapeModelPCA& shapePCA, const AppearanceModelPCA& appearancePCA)
     : pcaShape(shapePCA), pcaAppearance(appearancePCA) {};
+  AAMPCA(const ShapeModelPCA& shapePCA, const AppearanceModelPCA& appearancePCA, const CombinedModelPCA& combinedPCA)
+    : pcaShape(shapePCA), pcaAppearance(appearancePCA), pcaCombined(combinedPCA) {};
 
   int dimensionShape() const { return pcaShape.dimension(); };
   int dimensionAppearance() const { return pcaAppearance.dimension(); };
+  int dimensionCombined() const { return pcaCombined.dimension(); };
+  bool hasCombinedPCA() const { return pcaCombined.dimension() > 0; };
 
   const ShapeModelPCA& getShapePCA() const { return pcaShape; };
   const AppearanceModelPCA& getAppearancePCA() const { return pcaAppearance; };
+  const CombinedModelPCA& getCombinedPCA() const { return pcaCombined; };
   inline unique_ptr<AAMPCA> clone() const
   {
-    unique_ptr<AAMPCA> aam{ new AAMPCA(this->pcaShape, this->pcaAppearance) };
+    unique_ptr<AAMPCA> aam{ new AAMPCA(this->pcaShape, this->pcaAppearance, this->pcaCombined) };
     return aam;
   };
 
+  void trainCombined(const Mat& shapeParams, const Mat& appearanceParams, double retainedVariance=0.98);
+
   Rect getBound() const { return pcaAppearance.getBound(); };
 };
 
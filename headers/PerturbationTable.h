@@ -0,0 +1,68 @@
+/**
+ * Precomputed parameter perturbations for the model fitter
+ */
+
+#ifndef PERTURBATION_TABLE
+#define PERTURBATION_TABLE
+
+#include "master.h"
+#include "ModelPCA.h"
+
+/**
+ * Step sizes from which a [PerturbationTable] is generated.
+ * Shape and appearance steps are magnitudes, each of them
+ * produces both a positive and a negative perturbation.
+ * With [scaleByEigenvalue], they are expressed in standard deviations
+ * of each PCA component.
+ */
+struct PerturbationSteps
+{
+  vector<double> scales;
+  vector<Point2d> translations;
+  vector<double> shapeSteps;
+  vector<double> appearanceSteps;
+  vector<double> combinedSteps;
+  bool scaleByEigenvalue; // Multiply PCA steps by sqrt(eigenvalue) of each component
+
+  static PerturbationSteps getDefault()
+  {
+    return PerturbationSteps{
+      {1.01, 0.99, 1.0, 1.5, 0.5},
+      {Point2d(-1,0), Point2d(0,-1),
+       Point2d(1,0), Point2d(0,1),
+       Point2d(1,1), Point2d(1,-1),
+       Point2d(-1,1), Point2d(-1,-1),
+       Point2d(0,0)},
+      {0.05, 0.25, 1},
+      {0.05, 0.25, 1},
+      {0.05, 0.25, 1},
+      true
+    };
+  };
+};
+
+/**
+ * Immutable set of candidate perturbations, generated once per fitter
+ * so the expansion loop only has to read from it.
+ */
+class PerturbationTable
+{
+protected:
+  vector<double> scales;
+  vector<Point2d> translations;
+  vector<Mat> shapeParams;
+  vector<Mat> appearanceParams;
+  vector<Mat> combinedParams; // Empty unless the AAM has a combined PCA
+
+public:
+  PerturbationTable(const AAMPCA& aamPCA, const PerturbationSteps& steps);
+  virtual inline ~PerturbationTable(){};
+
+  inline const vector<double>& getScales() const { return this->scales; };
+  inline const vector<Point2d>& getTranslations() const { return this->translations; };
+  inline const vector<Mat>& getShapeParams() const { return this->shapeParams; };
+  inline const vector<Mat>& getAppearanceParams() const { return this->appearanceParams; };
+  inline const vector<Mat>& getCombinedParams() const { return this->combinedParams; };
+};
+
+#endif
@@ -0,0 +1,87 @@
+/**
+ * Photometric normalisation of appearance vectors
+ */
+
+#ifndef PHOTOMETRIC
+#define PHOTOMETRIC
+
+#include "master.h"
+#include "aux.h"
+
+enum PhotometricMode
+{
+  PHOTOMETRIC_OFF = 0,
+  PHOTOMETRIC_GLOBAL,     // One gain / bias over all channels
+  PHOTOMETRIC_PER_CHANNEL // One gain / bias for each channel
+};
+
+/**
+ * Removes the global brightness and contrast of appearance vectors
+ * (1 or 3 channels laid out one after another) by bringing each sample to
+ * a common mean and standard deviation. The targets are the average
+ * statistics of the training samples, so the normalised vectors
+ * still render as regular intensities.
+ */
+class PhotometricNormaliser
+{
+protected:
+  PhotometricMode mode;
+  int channels;
+  double targetMean[3];
+  double targetStd[3];
+
+public:
+  PhotometricNormaliser(PhotometricMode m = PHOTOMETRIC_OFF, int channels = 3);
+  inline virtual ~PhotometricNormaliser(){};
+
+  inline bool isEnabled() const { return this->mode != PHOTOMETRIC_OFF; };
+  inline PhotometricMode getMode() const { return this->mode; };
+  inline int getChannels() const { return this->channels; };
+  inline double getTargetMean(int c) const { return this->targetMean[c]; };
+  inline double getTargetStd(int c) const { return this->targetStd[c]; };
+
+  void train(const Mat& data);
+  void normalise(Mat vec) const;
+};
+
+/**
+ * Running least squares fit of o ≈ gain * p + bias.
+ * The residual is solved in closed form from the accumulated sums,
+ * and the residual over a subset of the pixels never exceeds
+ * the residual over all of them, so a partial fit is a lower bound.
+ */
+struct GainBiasFit
+{
+  double n, so, sp, soo, spp, sop;
+
+  inline GainBiasFit() : n(0), so(0), sp(0), soo(0), spp(0), sop(0) {};
+
+  inline void add(double o, double p)
+  {
+    n   += 1;
+    so  += o;
+    sp  += p;
+    soo += o*o;
+    spp += p*p;
+    sop += o*p;
+  };
+
+  inline double varO() const { return n > 0 ? soo - so*so/n : 0; };
+  inline double varP() const { return n > 0 ? spp - sp*sp/n : 0; };
+  inline double covOP() const { return n > 0 ? sop - so*sp/n : 0; };
+
+  inline double gain() const { return varP() > 1e-9 ? covOP() / varP() : 0; };
+  inline double bias() const { return n > 0 ? (so - gain()*sp) / n : 0; };
+
+  // Sum of squared residuals of the best gain and bias
+  inline double residual() const
+  {
+    double r = varP() > 1e-9 ? varO() - Aux::square(covOP()) / varP() : varO();
+    return max(0.0, r);
+  };
+
+  // Residual against a flat sample, where only the bias can be fitted
+  inline double blankResidual() const { return max(0.0, varO()); };
+};
+
+#endif
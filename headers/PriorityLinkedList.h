@@ -52,30 +52,40 @@ public:
     }
   };
 
-  virtual bool clear()
+  /**
+   * Empty the list. Elements are handed over to [dropped] if given,
+   * destroyed otherwise.
+   */
+  virtual bool clear(vector<unique_ptr<T>>* dropped = nullptr)
   {
+    if (dropped != nullptr && this->ptr != nullptr)
+      dropped->push_back(move(this->ptr));
     this->ptr = nullptr;
     if (this->next != nullptr)
-      this->next->clear();
+      this->next->clear(dropped);
+    return true;
   };
 
-  void take(int n)
+  /**
+   * Keep only the first [n] elements, the rest are handed over
+   * to [dropped] if given, destroyed otherwise.
+   */
+  void take(int n, vector<unique_ptr<T>>* dropped = nullptr)
   {
     if (this->ptr == nullptr) return;
+    else if (n <= 0)
+    {
+      clear(dropped);
+      this->next = nullptr;
+    }
     else if (this->next != nullptr)
     {
-      if (n <= 0)
-      {
-        this->ptr.release();
-        this->ptr = nullptr;
-      }
-      this->next->take(n-1);
-      
-      if (n <= 1)
+      if (n == 1)
       {
-        this->next.release();
+        this->next->clear(dropped);
         this->next = nullptr;
       }
+      else this->next->take(n-1, dropped);
     }
   };
 
@@ -86,17 +96,32 @@ public:
     else return 1 + this->next->size();
   };
 
+  /**
+   * Value of the k-th element (0-based),
+   * or the largest double if the list is shorter than that
+   */
+  double valueAt(int k) const
+  {
+    if (this->ptr == nullptr) return numeric_limits<double>::max();
+    else if (k <= 0) return this->v;
+    else if (this->next == nullptr) return numeric_limits<double>::max();
+    else return this->next->valueAt(k-1);
+  };
+
+  /**
+   * Log the values in order as a single debug line
+   */
   virtual void printValueList(string prefix) const
   {
-    cout << prefix;
-    if (this->ptr)
-      cout << this->v;
-    if (this->next != nullptr)
+    if (!Log::isEnabled(Log::Debug)) return;
+    ostringstream values;
+    values << prefix;
+    for (auto node = this; node != nullptr; node = node->next.get())
     {
-      cout << ", ";
-      this->next->printValueList("");
+      if (node->ptr) values << node->v;
+      if (node->next != nullptr) values << ", ";
     }
-    else cout << endl;
+    AAM_LOG(Debug) << values.str();
   };
 
   // TAOTOREVIEW: add cout 
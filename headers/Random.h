@@ -0,0 +1,72 @@
+/**
+ * Seedable random number generation
+ */
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include "master.h"
+#include <random>
+
+/**
+ * Random numbers drawn from a per-thread Mersenne Twister.
+ * Each thread starts from the same default seed, so a workload 
+ * is reproducible as long as every thread seeds (or not) its own 
+ * generator deterministically. No state is shared between threads.
+ */
+namespace Random
+{
+  typedef std::mt19937 Engine;
+
+  inline Engine& engine()
+  {
+    static thread_local Engine e(Engine::default_seed);
+    return e;
+  }
+
+  /**
+   * Reseed the generator of the calling thread
+   */
+  inline void seed(unsigned int s) { engine().seed(s); }
+
+  /**
+   * Uniform real number in [lo, hi)
+   */
+  inline double uniform(double lo = 0, double hi = 1)
+  {
+    std::uniform_real_distribution<double> d(lo, hi);
+    return d(engine());
+  }
+
+  /**
+   * Uniform integer in [lo, hi)
+   */
+  inline int uniformInt(int lo, int hi)
+  {
+    std::uniform_int_distribution<int> d(lo, hi - 1);
+    return d(engine());
+  }
+
+  inline double normal(double mean = 0, double std = 1)
+  {
+    std::normal_distribution<double> d(mean, std);
+    return d(engine());
+  }
+
+  /**
+   * Fill a single channel CV_64F matrix with normally distributed values
+   */
+  inline void fillNormal(Mat& m, double mean = 0, double std = 1)
+  {
+    assert(m.type() == CV_64FC1);
+    std::normal_distribution<double> d(mean, std);
+    auto& e = engine();
+    for (int j=0; j<m.rows; j++)
+    {
+      double* row = m.ptr<double>(j);
+      for (int i=0; i<m.cols; i++) row[i] = d(e);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,58 @@
+/**
+ * Shape-normalised texture frame
+ */
+
+#ifndef REFERENCE_FRAME
+#define REFERENCE_FRAME
+
+#include "master.h"
+#include "Shape.h"
+#include "MeshShape.h"
+#include "Appearance.h"
+#include "Channels.h"
+
+/**
+ * Fixed-size frame spanned by the mean shape.
+ * Every appearance is warped onto the same mesh, and only the pixels
+ * inside the mesh are kept, so appearance vectors have the same
+ * length and each element refers to the same point of the face.
+ *
+ * Vectors are laid out by channel like [Appearance::toRowVector],
+ * i.e. (c0 of every pixel, c1 of every pixel, ...).
+ */
+class ReferenceFrame
+{
+protected:
+  MeshShape meanShape;  // Mean shape as given, in model coordinates
+  MeshShape shape;      // Mean shape in frame coordinates
+  Size size;
+  int channels;         // Of the appearances warped onto the frame
+  Mat mask;             // CV_8UC1, non-zero inside the mesh
+  vector<Point> pixels; // In-mesh pixels, in raster order
+
+public:
+  static const int BORDER = 1;
+
+  inline ReferenceFrame() : channels(3) {};
+  ReferenceFrame(const Shape& meanShape, int width, int channels=3);
+  inline virtual ~ReferenceFrame(){};
+
+  inline bool empty() const { return this->pixels.empty(); };
+  inline int numPixels() const { return this->pixels.size(); };
+  inline int dimension() const { return this->channels * this->numPixels(); };
+  inline int getChannels() const { return this->channels; };
+  inline Size getSize() const { return this->size; };
+  inline const Mat& getMask() const { return this->mask; };
+  inline const MeshShape& getShape() const { return this->shape; };
+  inline const MeshShape& getMeanShape() const { return this->meanShape; };
+
+  // --------- Conversion ------------
+  Mat warp(const Appearance& app) const;
+  Mat toVector(const Appearance& app) const;
+  void toVector(const Appearance& app, Mat out) const;
+  Mat toGraphic(const Mat& vec) const;
+  void toGraphic(const Mat& vec, Mat& graphic) const;
+  Mat unwarp(const Mat& graphic, const MeshShape& target) const;
+};
+
+#endif
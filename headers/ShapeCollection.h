@@ -10,20 +10,25 @@
 #include "Shape.h"
 #include "BaseModel.h"
 #include "ModelCollection.h"
+#include "ShapeSet.h"
 
 class ShapeCollection : public ModelCollection
 {
 public:
   inline ShapeCollection() : ModelCollection() {};
-  ShapeCollection(const ShapeCollection& original) : ModelCollection(original.items) {};
-  ShapeCollection(const vector<BaseModel*>& models) : ModelCollection(models) {};
-  ShapeCollection(const vector<Shape*>& shapes);
+  ShapeCollection(const ShapeCollection& original); // Deep copy
+  ShapeCollection(ShapeCollection&& original) = default;
+  ShapeCollection(const vector<BaseModel*>& models) : ModelCollection(models) {}; // Takes ownership
+  ShapeCollection(vector<unique_ptr<BaseModel>>&& models) : ModelCollection(move(models)) {};
+  ShapeCollection(const vector<Shape*>& shapes); // Takes ownership
   
   // ---------- Transformations ---------------
   unique_ptr<ModelCollection> clone() const;
   void normaliseScalingTranslation();
   void normaliseRotation();
   void translateBy(const Point2d &p);
+  double sumProcrustesDistance(const BaseModel* targetModel) const;
+  unique_ptr<BaseModel> procrustesMean(double tol=1e-3, int maxIter=10);
 
   // ---------- I/O ------------------
   void renderShapeVariation(IO::GenericIO* io, Size sz, double scaleFactor=1.0, Point2d recentred=Point2d(0,0)) const;
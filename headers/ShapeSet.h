@@ -0,0 +1,69 @@
+/**
+ * Structure-of-arrays storage of a shape training set
+ */
+
+#ifndef SHAPE_SET
+#define SHAPE_SET
+
+#include "master.h"
+#include "Shape.h"
+#include "BaseModel.h"
+
+/**
+ * Run [Kernel<M>::run] with the number of landmarks [M] known at compile
+ * time for the fixed face topologies (68-point annotations), so the
+ * per-vertex loops have constant bounds. Any other count runs [Kernel<0>],
+ * which reads the count at runtime.
+ */
+template<template<int> class Kernel, typename... Args>
+inline auto dispatchLandmarks(int numPoints, Args&&... args)
+  -> decltype(Kernel<0>::run(numPoints, std::forward<Args>(args)...))
+{
+  switch (numPoints)
+  {
+    case 68: return Kernel<68>::run(numPoints, std::forward<Args>(args)...);
+    default: return Kernel<0>::run(numPoints, std::forward<Args>(args)...);
+  }
+}
+
+/**
+ * All landmarks of a series of shapes packed into two contiguous
+ * matrices, one for the x and one for the y coordinates.
+ * Row [i] holds the [numPoints] coordinates of the i-th shape,
+ * so batch operations are linear sweeps over plain arrays
+ * instead of visiting each [Shape] through a pointer.
+ *
+ * NOTE: All shapes of a set must have the same number of vertices.
+ */
+class ShapeSet
+{
+protected:
+  Mat xs; // N x M, CV_64FC1
+  Mat ys; // N x M, CV_64FC1
+
+public:
+  ShapeSet(int numShapes, int numPoints);
+  ShapeSet(const vector<BaseModel*>& shapes);
+  inline virtual ~ShapeSet(){};
+
+  inline int size() const { return this->xs.rows; };
+  inline int numPoints() const { return this->xs.cols; };
+  inline double* x(int i) { return this->xs.ptr<double>(i); };
+  inline double* y(int i) { return this->ys.ptr<double>(i); };
+  inline const double* x(int i) const { return this->xs.ptr<double>(i); };
+  inline const double* y(int i) const { return this->ys.ptr<double>(i); };
+
+  // ---------- Batch operations ---------------
+  Mat centroids() const; // N x 2
+  void translateBy(const Point2d& p);
+  void normaliseScalingTranslation();
+  void normaliseRotation(int baseIndex=0);
+  double sumProcrustesDistance(const Shape& target) const;
+
+  // ---------- Conversion ---------------
+  Mat toMat() const;
+  void toShape(int i, Shape& out) const;
+  void scatterTo(vector<unique_ptr<BaseModel>>& shapes) const;
+};
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * Step size scheduling for the model fitter
+ */
+
+#ifndef STEP_SCHEDULER
+#define STEP_SCHEDULER
+
+#include "master.h"
+
+enum SearchWith
+{
+  SCALING = 0,
+  TRANSLATION,
+  RESHAPING,
+  REAPPEARANCING,
+  COMBINED // Joint shape + appearance parameters
+  // TAOTOREVIEW: Rotation?
+};
+
+const int NUM_SEARCH_ACTIONS = COMBINED + 1;
+
+/**
+ * How the step multiplier of each action evolves during fitting
+ */
+struct StepPolicy
+{
+  double decay;            // Shrinking ratio when an action stalls or rarely improves
+  double growth;           // Growing ratio when an action frequently improves
+  double lowAcceptance;    // Shrink below this acceptance rate
+  double highAcceptance;   // Grow above this acceptance rate
+  double minStep;          // The action is exhausted once its step drops below this
+  double maxStep;
+
+  static StepPolicy getDefault()
+  {
+    return StepPolicy{ 0.67, 1.25, 0.02, 0.25, 0.125, 1.0 };
+  };
+};
+
+/**
+ * Keeps an independent step multiplier per [SearchWith] action
+ * and adapts it from the rate of candidates which improve on their parent.
+ */
+class StepScheduler
+{
+protected:
+  StepPolicy policy;
+  double steps[NUM_SEARCH_ACTIONS];
+  long long numEvaluated[NUM_SEARCH_ACTIONS];
+  long long numAccepted[NUM_SEARCH_ACTIONS];
+  double lastAcceptance[NUM_SEARCH_ACTIONS];
+
+public:
+  StepScheduler(const StepPolicy& policy);
+  virtual inline ~StepScheduler(){};
+
+  void reset();
+  void reset(SearchWith action);
+  inline double step(SearchWith action) const { return this->steps[action]; };
+  inline double acceptanceRate(SearchWith action) const { return this->lastAcceptance[action]; };
+  inline long long evaluated(SearchWith action) const { return this->numEvaluated[action]; };
+  inline long long accepted(SearchWith action) const { return this->numAccepted[action]; };
+
+  void record(SearchWith action, int evaluated, int accepted);
+  void adapt(SearchWith action);
+  bool shrink(SearchWith action);
+};
+
+#endif
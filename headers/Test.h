@@ -12,43 +12,45 @@
 #include "FittedAAM.h"
 #include "ModelFitter.h"
 #include "PriorityLinkedList.h"
+#include "MatArena.h"
+#include "Random.h"
 
 const double CANVAS_SIZE     = 300.0;
 const double CANVAS_HALFSIZE = CANVAS_SIZE / 2.0;
 const double NOISE_T         = 15.0;
 const double NOISE_R         = 0.665;
 
-inline MeshShape initialMesh(int shapeSize)
+inline MeshShape initialMesh(int shapeSize, unsigned int seed = time(NULL))
 {
   const double MARGIN = 40;
-  srand(time(NULL));
+  Random::seed(seed);
   vector<Point2d> vs;
   for (int i=0; i<shapeSize; i++)
   {
-    double x = MARGIN + rand() % (int)(CANVAS_SIZE - MARGIN*2);
-    double y = MARGIN + rand() % (int)(CANVAS_SIZE - MARGIN*2);
+    double x = MARGIN + Random::uniformInt(0, (int)(CANVAS_SIZE - MARGIN*2));
+    double y = MARGIN + Random::uniformInt(0, (int)(CANVAS_SIZE - MARGIN*2));
     vs.push_back(Point2d(x, y));
   }
   return MeshShape(vs);
 }
 
-inline unique_ptr<ShapeCollection> initialShapeCollection(int num, int shapeSize)
+inline unique_ptr<ShapeCollection> initialShapeCollection(int num, int shapeSize, unsigned int seed = time(NULL))
 {
   cout << GREEN << "Generating initial shapes of size " << RESET 
     << num << " x " << shapeSize << endl;
   vector<Shape*> trainset;
-  srand(time(NULL));
+  Random::seed(seed);
   for (int i=0; i<num; i++)
   {
     Mat m(shapeSize, 2, CV_64FC1);
-    double nr = NOISE_R * (rand()%1000)/1000.0;
+    double nr = NOISE_R * Random::uniform();
     for (int n=0; n<shapeSize; n++)
     {
       double angle = 2 * M_PI * (double)n / (double)shapeSize + nr;
       double x0 = CANVAS_HALFSIZE + (CANVAS_HALFSIZE * cos(angle));
       double y0 = CANVAS_HALFSIZE + (CANVAS_HALFSIZE * sin(angle));
-      double n0 = NOISE_T * (rand()%1000)/1000.0;
-      double n1 = NOISE_T * (rand()%1000)/1000.0;
+      double n0 = NOISE_T * Random::uniform();
+      double n1 = NOISE_T * Random::uniform();
       m.at<double>(n, 0) = x0 + n0 - n1;
       m.at<double>(n, 1) = y0 - n0 + n1;
     }
@@ -83,21 +85,25 @@ inline Mat chessPattern(int stepSize, Size size)
   return mat;
 }
 
-inline unique_ptr<AppearanceCollection> initialAppearanceCollection(int num, int shapeSize)
+/**
+ * Generate [num] appearances by warping a chess pattern onto randomly displaced meshes.
+ * Pass [visualise] = false to generate the collection without any window.
+ */
+inline unique_ptr<AppearanceCollection> initialAppearanceCollection(int num, int shapeSize, unsigned int seed = time(NULL), bool visualise = true, int channels = 3)
 {
   cout << GREEN << "Generating initial appearances of size " << RESET 
     << num << " x " << shapeSize << endl;
 
   // Generate a base shape and texture
-  auto baseShape = MeshShape(initialMesh(shapeSize));
-  auto baseTexture = chessPattern(7, Size(CANVAS_SIZE, CANVAS_SIZE));
+  auto baseShape = MeshShape(initialMesh(shapeSize, seed));
+  auto baseTexture = toChannels(chessPattern(7, Size(CANVAS_SIZE, CANVAS_SIZE)), channels);
 
   // Generate [n] random displacements on the base shape
   auto noiseConstraint = Point2d(6.5, 6.5);
-  srand(time(NULL));
+  Random::seed(seed + 1);
   vector<Appearance*> appearances;
 
-  Mat backCanvas = Mat::zeros(CANVAS_SIZE, CANVAS_SIZE, CV_8UC3);
+  Mat backCanvas = Mat::zeros(CANVAS_SIZE, CANVAS_SIZE, CV_8UC(channels));
   
   for (int n=0; n<num; n++)
   {
@@ -107,18 +113,20 @@ inline unique_ptr<AppearanceCollection> initialAppearanceCollection(int num, int
     // Create an appearance on the base shape
     // then warp it onto the new shape with random noise added
     auto app = new Appearance(baseShape, baseTexture);
-
-    auto ioShape = IO::WindowIO("generated mesh");
-    auto ioDebug = IO::WindowIO("generated appearance");
-    newShape.render(&ioShape, backCanvas);
-    
     app->realignTo(newShape);
-    app->render(&ioDebug, backCanvas);
     appearances.push_back(app);
 
-    moveWindow("generated mesh", 15, 15);
-    moveWindow("generated appearance", CANVAS_SIZE+15, 15);
-    waitKey(120);
+    if (visualise)
+    {
+      auto ioShape = IO::WindowIO("generated mesh");
+      auto ioDebug = IO::WindowIO("generated appearance");
+      newShape.render(&ioShape, backCanvas);
+      app->render(&ioDebug, backCanvas);
+
+      moveWindow("generated mesh", 15, 15);
+      moveWindow("generated appearance", CANVAS_SIZE+15, 15);
+      waitKey(120);
+    }
   }
 
   unique_ptr<AppearanceCollection> list(new AppearanceCollection(appearances));
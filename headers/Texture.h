@@ -9,6 +9,26 @@
 #include "IO.h"
 #include "aux.h"
 #include "Triangle.h"
+#include "Trace.h"
+#include "Channels.h"
+#include "MatArena.h"
+
+/**
+ * Inverse of the homogeneous vertex matrix [x; y; 1] of a source triangle,
+ * relative to its bounding rect. The affine transformation onto any
+ * destination triangle D (2x3) is then D•B, with no system to solve.
+ */
+struct TriangleBasis
+{
+  Rect srcRect;  // Bounding rect of the source vertices
+  double inv[9]; // Row major
+  bool degenerate;
+
+  inline TriangleBasis() : degenerate(true) {};
+  TriangleBasis(const Point2f (&src)[Triangle::NUM_VERTICES]);
+
+  void affineTo(const Point2f (&dest)[Triangle::NUM_VERTICES], Mat& W) const;
+};
 
 /**
  * Texture coupled with a triangular face
@@ -33,9 +53,51 @@ public:
   virtual void save(const string path) const;
   virtual void load(const string path);
   virtual Mat render(IO::GenericIO* io, Mat background, bool withVertices=true, bool withEdges=true, double scaleFactor=1.0, Point2d recentre=Point2d(0,0)) const;
+  void renderInto(Mat& canvas, bool withVertices=true, bool withEdges=true) const;
 
   //------ Operators / Transformations -------
-  Texture realignTo(const Triangle &newBound, Mat* newVertexRef, Mat* m) const;
+  Texture realignTo(const Triangle &newBound, Mat* newVertexRef, Mat* m, const TriangleBasis* basis=nullptr, const Rect* clip=nullptr) const;
+};
+
+/**
+ * Per-thread cache of the [TriangleBasis] of each texture of a mesh.
+ * Entries are keyed by the source vertices and triangles, so moving a
+ * vertex misses the cache and the bases are rebuilt. Fitting candidates
+ * which share the same scale and origin warp from identical mean-shape
+ * triangles, and reuse the same entry.
+ */
+class TextureBasisCache
+{
+private:
+  struct Entry
+  {
+    Mat vertices; // Copy of the source vertices
+    vector<Triangle> triangles;
+    vector<TriangleBasis> bases;
+  };
+  vector<Entry> entries;
+  size_t next; // Entry replaced on the next miss
+
+  TextureBasisCache(const TextureBasisCache& another) = delete;
+
+public:
+  static const size_t CAPACITY = 8;
+
+  inline TextureBasisCache() : next(0) { this->entries.reserve(CAPACITY); };
+  virtual inline ~TextureBasisCache(){};
+
+  static inline TextureBasisCache& local()
+  {
+    static thread_local TextureBasisCache cache;
+    return cache;
+  };
+
+  /**
+   * Bases of [textures], one per texture, which all refer to
+   * the same vertices. Valid until the next call on this thread.
+   */
+  const TriangleBasis* of(const vector<Texture>& textures);
+  inline void clear() { this->entries.clear(); this->next = 0; };
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+/**
+ * Lightweight hot-path instrumentation
+ * Scoped timers and counters, exportable as JSON summary or Chrome trace.
+ * Each thread records into its own log, the logs are only merged on export.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "master.h"
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <unordered_map>
+#include <thread>
+
+namespace Trace
+{
+  typedef chrono::steady_clock Clock;
+
+  /**
+   * Aggregated timings of a named stage
+   */
+  struct TimerStat
+  {
+    long long count;
+    double totalMs;
+    double minMs;
+    double maxMs;
+  };
+
+  extern std::atomic<bool> enabled;
+
+  inline bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+  // [maxEvents] caps the trace events kept by each thread
+  void enable(bool on = true, size_t maxEvents = 1000000);
+  void reset();
+
+  void count(const char* name, long long n = 1);
+  void record(const char* name, Clock::time_point start, Clock::time_point end);
+
+  map<string, TimerStat> timers();
+  map<string, long long> counters();
+
+  string toJSON();
+  string toChromeTrace();
+  bool saveJSON(const string& path);
+  bool saveChromeTrace(const string& path);
+
+  /**
+   * Times the enclosing scope, costs a single flag check when tracing is off
+   */
+  class ScopedTimer
+  {
+  private:
+    const char* name;
+    bool active;
+    Clock::time_point start;
+  public:
+    inline ScopedTimer(const char* name) : name(name), active(isEnabled())
+    {
+      if (active) start = Clock::now();
+    };
+    inline ~ScopedTimer()
+    {
+      if (active) record(name, start, Clock::now());
+    };
+  };
+}
+
+#define TRACE_CONCAT_(a,b) a##b
+#define TRACE_CONCAT(a,b) TRACE_CONCAT_(a,b)
+#define TRACE_SCOPE(name) Trace::ScopedTimer TRACE_CONCAT(_traceScope, __LINE__)(name)
+#define TRACE_COUNT(name, n) do { if (Trace::isEnabled()) Trace::count(name, n); } while (0)
+
+#endif
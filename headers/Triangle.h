@@ -11,14 +11,30 @@
 class Triangle
 {
 public:
+  static const int NUM_VERTICES = 3;
   int a, b, c;
 
   inline Triangle(int v1, int v2, int v3) : a(v1), b(v2), c(v3) {};
   inline ~Triangle(){};
 
-  inline int get(int i) const { int w[3] = {a,b,c}; return w[i]; };
+  inline int get(int i) const { return i == 0 ? a : (i == 1 ? b : c); };
   void boundary(const Mat &m, double& minX, double& minY, double& maxX, double& maxY) const;
 
+  /**
+   * Vertices looked up from the (N x 2, CV_64FC1) vertex matrix
+   * into a fixed-size array, e.g. Point2f, Point2d or Point
+   */
+  template<typename P> inline void toArray(P (&p)[NUM_VERTICES], const Mat& mat) const
+  {
+    const int vx[NUM_VERTICES] = {a, b, c};
+    for (int i=0; i<NUM_VERTICES; i++)
+    {
+      const double* row = mat.ptr<double>(vx[i]);
+      p[i].x = row[0];
+      p[i].y = row[1];
+    }
+  };
+
   vector<Point2f> toFloatVector(const Mat& mat) const;
   vector<Point2d> toVector(const Mat& mat) const;
   void toIntArray(Point* p, const Mat& mat) const;
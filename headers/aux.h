@@ -3,6 +3,7 @@
 
 #include "master.h" 
 #include "math.h"
+#include "Random.h"
 
 namespace Aux
 {
@@ -148,10 +149,13 @@ namespace Aux
     return e;
   }
 
+  /**
+   * Normally distributed matrix drawn from the thread RNG (see [Random::seed])
+   */
   inline Mat randomMat(Size dim, double mean = 0, double std = 1)
   {
-    Mat m(dim, CV_32FC1);
-    randn(m, Scalar(mean), Scalar(std));
+    Mat m(dim, CV_64FC1);
+    Random::fillNormal(m, mean, std);
     return m;
   }
 
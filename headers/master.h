@@ -33,11 +33,13 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include "Log.h"
+
 // Build modes
-#define DEBUG
+// AAM_DEBUG and AAM_LOG_LEVEL are set by CMake (see options in CMakeLists.txt)
 //#define DEBUG_PRIORITY_LIST
 
-#ifdef DEBUG
+#ifdef AAM_DEBUG
 #include "backward.h"
 using namespace backward;
 
@@ -64,23 +66,19 @@ inline void adjustStackSize()
   {
     if (lim.rlim_cur < minStackSize)
     {
-      #ifdef DEBUG
-      cout << MAGENTA << "[Overriding stack size to "<< minStackSize/(1024*1024) << " MB]" 
-        << RESET << " (formerly " << lim.rlim_cur/(1024*1024) << " MB)" << endl;
-      #endif
+      AAM_LOG(Debug) << MAGENTA << "[Overriding stack size to "<< minStackSize/(1024*1024) << " MB]" 
+        << RESET << " (formerly " << lim.rlim_cur/(1024*1024) << " MB)";
 
       lim.rlim_cur = minStackSize;
       result = setrlimit(RLIMIT_STACK, &lim);
       if (result != 0)
       {
-        cout << YELLOW << "[WARNING] unable to override stack size" << RESET << endl;
+        AAM_LOG(Warn) << YELLOW << "[WARNING] unable to override stack size" << RESET;
       }
     }
     else
     {
-      #ifndef DEBUG
-      cout << MAGENTA << "[Stack size remains " << lim.rlim_cur / (1024*1024) << " MB]" << RESET << endl;
-      #endif
+      AAM_LOG(Debug) << MAGENTA << "[Stack size remains " << lim.rlim_cur / (1024*1024) << " MB]" << RESET;
     }
   }
 }
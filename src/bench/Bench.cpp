@@ -0,0 +1,179 @@
+/**
+ * Benchmark suite of the fitting and warping hot paths
+ * ------------------------------
+ * Arguments:
+ *   aam_bench [seed] [repeat] [trace]
+ *
+ * With [trace], the per-stage timers and counters are exported to
+ * [trace].json (summary) and [trace].trace.json (Chrome trace).
+ *
+ * Every dataset is synthesised from [seed], so two runs with
+ * the same seed measure exactly the same workload.
+ */
+
+#include "Test.h"
+
+struct BenchResult
+{
+  string name;
+  int iters;
+  double totalMs;
+  double minMs;
+  double maxMs;
+};
+
+template<typename F> BenchResult runBench(const string& name, int iters, F fn)
+{
+  // Warm up (lazy allocations, caches)
+  fn();
+
+  BenchResult r{ name, iters, 0, numeric_limits<double>::max(), 0 };
+  for (int i=0; i<iters; i++)
+  {
+    auto t0 = chrono::steady_clock::now();
+    fn();
+    auto t1 = chrono::steady_clock::now();
+    double ms = chrono::duration<double, milli>(t1 - t0).count();
+    r.totalMs += ms;
+    r.minMs = min(r.minMs, ms);
+    r.maxMs = max(r.maxMs, ms);
+  }
+  return r;
+}
+
+void printResult(const BenchResult& r)
+{
+  double mean = r.totalMs / r.iters;
+  cout << fmt::format("{0:<28} {1:>8d} {2:>12.4f} {3:>12.4f} {4:>12.4f} {5:>12.1f}",
+    r.name, r.iters, mean, r.minMs, r.maxMs, 1000.0 / mean) << endl;
+}
+
+int main(int argc, char** argv)
+{
+  signal(SIGSEGV, segFaultHandler);
+  adjustStackSize();
+  Log::setLevel(Log::Warn); // Keep stdout out of the measurements
+
+  const unsigned int seed = argc > 1 ? (unsigned int)atoi(argv[1]) : 1;
+  const int repeat        = argc > 2 ? max(1, atoi(argv[2])) : 1;
+  const string tracePath  = argc > 3 ? string(argv[3]) : "";
+  const int TRAIN_SET_SIZE = 16;
+  const int SHAPE_SIZE     = 6;
+  const int MAX_DIM        = 3 * 8000;
+
+  cout << GREEN << "[Preparing datasets] seed = " << seed << RESET << endl;
+
+  // Training set and models, same recipe as the fitting test
+  auto aamCollection   = initialAppearanceCollection(TRAIN_SET_SIZE, SHAPE_SIZE, seed, false);
+  auto shapeCollection = aamCollection->toShapeCollection();
+  auto meanAppearanceModel = aamCollection->procrustesMean();
+  auto meanShapeModel      = shapeCollection->procrustesMean();
+  auto meanAppearance  = dynamic_cast<Appearance*>(meanAppearanceModel.get());
+  auto meanShape       = dynamic_cast<Shape*>(meanShapeModel.get());
+  unique_ptr<AppearanceModelPCA> pcaAppearance{ dynamic_cast<AppearanceModelPCA*>(aamCollection->pca(meanAppearance, MAX_DIM)) };
+  unique_ptr<ShapeModelPCA> pcaShape{ dynamic_cast<ShapeModelPCA*>(shapeCollection->pca(meanShape, -1)) };
+  unique_ptr<AAMPCA> aamPCA{ new AAMPCA(*pcaShape, *pcaAppearance) };
+
+  // Synthetic sample generated from the trained model
+  Random::seed(seed);
+  unique_ptr<BaseFittedModel> sampleModel{ new FittedAAM(aamPCA) };
+  sampleModel->setScale(0.88);
+  sampleModel->setOrigin(25, 34.4);
+  sampleModel->setShapeParam(Aux::randomMat(sampleModel->shapeParam.size(), 0, 5.5));
+  sampleModel->setAppearanceParam(Aux::randomMat(sampleModel->appearanceParam.size(), 0, 25));
+  unique_ptr<Appearance> sampleAppearance{ sampleModel->toAppearance() };
+  IO::MatIO ioSample;
+  sampleAppearance->render(&ioSample, Mat::zeros(sampleAppearance->getSpannedSize(), CV_8UC3), false, true);
+  Mat sampleMat = ioSample.get();
+
+  // Texture warping workload
+  auto texture = chessPattern(7, Size(CANVAS_SIZE, CANVAS_SIZE));
+  double srcData[] = { 10, 10, 250, 30, 60, 280 };
+  double destData[] = { 40, 20, 270, 90, 20, 260 };
+  Mat srcVertices(3, 2, CV_64FC1, srcData);
+  Mat destVertices(3, 2, CV_64FC1, destData);
+  Mat warpCanvas = Mat::zeros(CANVAS_SIZE, CANVAS_SIZE, CV_8UC3);
+  Texture srcTexture(Triangle(0, 1, 2), &srcVertices, &texture);
+
+  // Mesh construction workload
+  auto meshVertices = initialMesh(32, seed).toPoints();
+
+  cout << GREEN << "[Running benchmarks] repeat = " << repeat << RESET << endl;
+  cout << fmt::format("{0:<28} {1:>8} {2:>12} {3:>12} {4:>12} {5:>12}",
+    "operation", "iters", "mean (ms)", "min (ms)", "max (ms)", "ops/s") << endl;
+
+  printResult(runBench("Texture::realignTo", 2000 * repeat, [&]()
+  {
+    srcTexture.realignTo(Triangle(0, 1, 2), &destVertices, &warpCanvas);
+  }));
+
+  printResult(runBench("MeshShape::MeshShape", 200 * repeat, [&]()
+  {
+    MeshShape mesh(meshVertices);
+  }));
+
+  printResult(runBench("ShapeModelPCA::toParam", 2000 * repeat, [&]()
+  {
+    pcaShape->toParam(meanShape);
+  }));
+
+  printResult(runBench("AppearanceModelPCA::toParam", 200 * repeat, [&]()
+  {
+    pcaAppearance->toParam(meanAppearance);
+  }));
+
+  printResult(runBench("AppearanceModelPCA::toApp", 200 * repeat, [&]()
+  {
+    unique_ptr<Appearance> app{ pcaAppearance->toAppearance(sampleModel->appearanceParam) };
+  }));
+
+  unique_ptr<BaseFittedModel> probe{ new FittedAAM(aamPCA) };
+  probe->setOrigin(20, 30);
+  printResult(runBench("FittedAAM::measureError", 100 * repeat, [&]()
+  {
+    probe->measureError(sampleMat, 2);
+  }));
+
+  auto crit = FittingCriteria::getDefault();
+  crit.numMaxIter = 20;
+  crit.maxTreeSize = 4;
+  crit.numModelsToGeneratePerIter = 4;
+  crit.minErrorImprovement = 5;
+  crit.initScale = 1;
+  crit.initPos = Point2d(10, 10);
+  crit.minScale = 0.76;
+  crit.maxScale = 1.5;
+  printResult(runBench("ModelFitter::fit", repeat, [&]()
+  {
+    ModelFitter fitter(aamPCA, crit, sampleMat);
+    unique_ptr<BaseFittedModel> initModel{ new FittedAAM(aamPCA) };
+    fitter.fit(initModel, 3);
+  }));
+
+  auto coarseCrit = crit;
+  coarseCrit.coarseSearch = true;
+  printResult(runBench("ModelFitter::fit (coarse)", repeat, [&]()
+  {
+    ModelFitter fitter(aamPCA, coarseCrit, sampleMat);
+    unique_ptr<BaseFittedModel> initModel{ new FittedAAM(aamPCA) };
+    fitter.fit(initModel, 3);
+  }));
+
+  if (!tracePath.empty())
+  {
+    // One traced fit, so the breakdown is not skewed by the timed loops above
+    Trace::reset();
+    Trace::enable();
+    {
+      ModelFitter fitter(aamPCA, crit, sampleMat);
+      unique_ptr<BaseFittedModel> initModel{ new FittedAAM(aamPCA) };
+      fitter.fit(initModel, 3);
+    }
+    Trace::enable(false);
+    Trace::saveJSON(tracePath + ".json");
+    Trace::saveChromeTrace(tracePath + ".trace.json");
+    cout << GREEN << "[Trace written] " << tracePath << ".json" << RESET << endl;
+  }
+
+  return 0;
+}
@@ -1,8 +1,95 @@
 #include "AAM2D.h"
+#include "FittedAAM.h"
+#include <thread>
+#include <atomic>
 
-void AAM2D::fit(Mat im)
+/**
+ * Fitting criteria initialised from a face detection :
+ * the model bound is scaled to the width of the face, 
+ * and moved onto its upper-left corner.
+ */
+FittingCriteria AAM2D::seedFromDetection(const Rect& face) const
 {
+  FittingCriteria seeded = this->crit;
+  Rect bound = this->aamPCA->getBound();
+  if (bound.width <= 0) return seeded;
 
+  double scale = face.width / (double)bound.width;
+  seeded.initScale = min(max(scale, crit.minScale), crit.maxScale);
+  seeded.initPos = Point2d(
+    max(0, face.x - bound.x),
+    max(0, face.y - bound.y));
+  return seeded;
+}
+
+/**
+ * Fit the model onto every face found in [im], one fitter per detection,
+ * run in parallel. Without any detection, a single fit starts
+ * from the initial position of the criteria.
+ */
+vector<unique_ptr<BaseFittedModel>> AAM2D::fit(Mat im)
+{
+  TRACE_SCOPE("AAM2D::fit");
+  vector<unique_ptr<BaseFittedModel>> fitted;
+  if (this->aamPCA == nullptr)
+  {
+    AAM_LOG(Error) << RED << "AAM2D::fit : no trained model to fit" << RESET;
+    return fitted;
+  }
+
+  vector<FittingCriteria> seeds;
+  if (this->faceFinder != nullptr)
+  {
+    for (auto& face : this->faceFinder->find(im))
+      seeds.push_back(seedFromDetection(face));
+  }
+  if (seeds.empty())
+  {
+    AAM_LOG(Info) << "AAM2D::fit : no face detected, starting from " << crit.initPos;
+    seeds.push_back(this->crit);
+  }
+
+  // Each worker owns its fitter, the scratch arena is per thread
+  fitted.resize(seeds.size());
+  std::atomic<int> nextSeed(0);
+  auto worker = [&]()
+  {
+    int n;
+    while ((n = nextSeed++) < (int)seeds.size())
+    {
+      try
+      {
+        ModelFitter fitter(this->aamPCA, seeds[n], im);
+        unique_ptr<BaseFittedModel> initModel{ new FittedAAM(this->aamPCA) };
+        fitted[n] = fitter.fit(initModel, this->skipPixels);
+      }
+      // Nothing may escape a worker thread, the library also throws pointers
+      catch (exception& e)
+      {
+        AAM_LOG(Error) << RED << "AAM2D::fit : fitting #" << n << " failed, " << e.what() << RESET;
+      }
+      catch (exception* e)
+      {
+        AAM_LOG(Error) << RED << "AAM2D::fit : fitting #" << n << " failed, " << e->what() << RESET;
+        delete e;
+      }
+      catch (...)
+      {
+        AAM_LOG(Error) << RED << "AAM2D::fit : fitting #" << n << " failed" << RESET;
+      }
+    }
+  };
+
+  int numThreads = (int)min((size_t)max(1u, std::thread::hardware_concurrency()), seeds.size());
+  vector<std::thread> threads;
+  for (int i=1; i<numThreads; i++) threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads) t.join();
+
+  // Drop the failed fits
+  fitted.erase(remove(fitted.begin(), fitted.end(), nullptr), fitted.end());
+  AAM_LOG(Debug) << "AAM2D::fit : " << fitted.size() << " of " << seeds.size() << " fits completed";
+  return fitted;
 }
 
 void AAM2D::saveToFile(const string& modelFileName) const
@@ -18,4 +105,4 @@ void AAM2D::loadFromFile(const string& modelFileName)
 void AAM2D::trainFromFileList(const vector<string>& filelist)
 {
   
-}
\ No newline at end of file
+}
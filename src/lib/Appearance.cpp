@@ -30,9 +30,7 @@ void Appearance::reinitTextures()
 
 const double Appearance::procrustesDistance(const BaseModel* that) const
 {
-  #ifdef DEBUG
-  cout << "Appearance::procrustesDistance" << endl;
-  #endif
+  AAM_LOG(Verbose) << "Appearance::procrustesDistance";
   const auto thatApp = dynamic_cast<const Appearance*>(that);
   Mat thisMat  = this->toRowVector();
   Mat thatMat  = thatApp->toRowVector();
@@ -42,21 +40,20 @@ const double Appearance::procrustesDistance(const BaseModel* that) const
 
 Mat Appearance::render(IO::GenericIO* io, Mat background, bool withVertices, bool withEdges, double scaleFactor, Point2d recentre) const
 {
-  Size size = background.size();
-  
-  Mat canvas = Mat(size.height, size.width, CV_64FC3);
-  background.copyTo(canvas);
+  if (IO::isHeadless(io)) return background;
+
+  // All triangles are drawn onto a single copy of the background
+  Mat canvas = background.clone();
 
-  #ifdef DEBUG
   if (this->textureList.size()==0)
-    cout << YELLOW << "Texture list is empty, unable to render anything." << RESET << endl;
-  #endif
+    AAM_LOG(Warn) << YELLOW << "Texture list is empty, unable to render anything." << RESET;
 
-  for (auto texture : this->textureList)
+  for (auto& texture : this->textureList)
   {
-    canvas = texture.render(io, canvas, withVertices, withEdges);
+    texture.renderInto(canvas, withVertices, withEdges);
   }
 
+  io->render(canvas);
   return canvas;
 }
 
@@ -69,21 +66,20 @@ unique_ptr<BaseModel> Appearance::clone() const
 Mat Appearance::toRowVector() const
 {
   /**
-   * NOTE: assume the matrix contains 3 channels
+   * NOTE: channels are concatenated one after another
    */
   auto bound = this->mesh.getBound();
   auto N = bound.width * bound.height;
+  const int CN = this->channels();
 
   Mat channels[3];
   split(this->graphic(bound), channels);
-  Mat row(1, N*3, CV_8UC1);
+  Mat row(1, N*CN, CV_8UC1);
 
   // Concatenate all row vectors
-  Mat channelRows[3];
-  for (int i=0; i<3; i++)
+  for (int i=0; i<CN; i++)
   {
-    channelRows[i] = channels[i].reshape(1,1);
-    channelRows[i].copyTo(row(Rect(N*i, 0, N, 1)));
+    channels[i].reshape(1,1).copyTo(row(Rect(N*i, 0, N, 1)));
   }
 
   Mat rowDouble = Mat(row.size(), CV_64FC1);
@@ -94,25 +90,43 @@ Mat Appearance::toRowVector() const
 
 Mat Appearance::toRowVectorReduced(int maxSize) const 
 {
-  assert(maxSize % 3 == 0);
-  Mat rowVec = toRowVector();
-  int N = rowVec.cols/3;
-  int K = maxSize/3;
-
-  // Chop original vector into 3 different channels,
-  // Then shrink each of them before concatenating the results.
   Mat reduced(1, maxSize, CV_64FC1);
-  Mat rowComponents[3];
-  Mat reducedComponents[3];
-  for (int i=0; i<3; i++)
+  this->toRowVectorReduced(maxSize, reduced);
+  return reduced;
+}
+
+/**
+ * Shrink each channel of the row vector down to [maxSize]/channels elements.
+ * The intermediate channels live in the thread's scratch arena,
+ * so concurrent callers don't contend on the heap.
+ */
+void Appearance::toRowVectorReduced(int maxSize, Mat out) const
+{
+  const int CN = this->channels();
+  assert(maxSize % CN == 0);
+  assert(out.rows == 1 && out.cols == maxSize && out.type() == CV_64FC1);
+  auto bound = this->mesh.getBound();
+  int N = bound.width * bound.height;
+  int K = maxSize/CN;
+
+  MatArena& arena = MatArena::local();
+  MatArena::Scope scope(arena);
+  Mat channels[3];
+  for (int i=0; i<CN; i++)
   {
-    rowComponents[i] = rowVec(Rect(i*N, 0, N, 1));
-    reducedComponents[i] = Mat(1, K, CV_64FC1);
-    resize(rowComponents[i], reducedComponents[i], reducedComponents[i].size());
-    reducedComponents[i].copyTo(reduced(Rect(i*K, 0, K, 1)));
+    channels[i] = arena.acquire(bound.height, bound.width, CV_8UC1);
   }
+  split(this->graphic(bound), channels);
 
-  return reduced;
+  // Chop original vector into its channels,
+  // Then shrink each of them before concatenating the results.
+  Mat rowComponent = arena.acquire(1, N, CV_64FC1);
+  for (int i=0; i<CN; i++)
+  {
+    channels[i].reshape(1, 1).convertTo(rowComponent, CV_64FC1);
+    Mat reducedComponent = out(Rect(i*K, 0, K, 1));
+    resize(rowComponent, reducedComponent, reducedComponent.size());
+  }
 }
 
 Mat Appearance::toColVector() const 
@@ -123,6 +137,7 @@ Mat Appearance::toColVector() const
 
 void Appearance::realignTo(MeshShape& newShape)
 {
+  TRACE_SCOPE("Appearance::realignTo");
   assert(this->mesh.mat.rows == newShape.mat.rows);
 
   auto originalVertices = this->mesh.toPoints();
@@ -131,20 +146,33 @@ void Appearance::realignTo(MeshShape& newShape)
 
   if (this->textureList.size() != targetTriangles.size())
   {
-    #ifdef DEBUG
-    cout << YELLOW << "WARNING> " << RESET << "Unequal number of triangles, skip realignment" << endl;
-    #endif
+    AAM_LOG(Warn) << YELLOW << "WARNING> " << RESET << "Unequal number of triangles, skip realignment";
     return;
   }
 
   // Warp the attached graphic onto the target
   const int span = 16;
   auto newSize = newShape.getSpannedSize();
-  Mat warped = Mat::zeros(newSize.height + span, newSize.width + span, CV_8UC3);
-  for (int ti=0; ti<targetTriangles.size(); ti++)
+  Mat warped = Mat::zeros(newSize.height + span, newSize.width + span, this->graphic.type());
+  // Bands of rows are warped concurrently, each one visits the triangles
+  // in order and only writes its own rows, so the pixels shared by
+  // adjacent triangles are owned by the same triangle as in a sequential
+  // warp. Values may still differ by 1 from it, as the warp of each band
+  // is translated and rounded separately, which is below visible noise
+  const int BAND_ROWS = 32;
+  const int numBands = (warped.rows + BAND_ROWS - 1) / BAND_ROWS;
+  const TriangleBasis* bases = TextureBasisCache::local().of(this->textureList);
+  parallel_for_(Range(0, numBands), [&](const Range& r)
   {
-    this->textureList[ti].realignTo(targetTriangles[ti], &newShape.mat, &warped);
-  }
+    for (int band=r.start; band<r.end; band++)
+    {
+      Rect clip(0, band * BAND_ROWS, warped.cols, min(BAND_ROWS, warped.rows - band * BAND_ROWS));
+      for (int ti=0; ti<targetTriangles.size(); ti++)
+      {
+        this->textureList[ti].realignTo(targetTriangles[ti], &newShape.mat, &warped, &bases[ti], &clip);
+      }
+    }
+  });
 
   // Move all vertices to match their corresponding counterparts in new shape
   for (int n=0; n<originalVertices.size(); n++)
@@ -172,9 +200,7 @@ void Appearance::recentre(Point2d t)
   int w = this->graphic.cols + t.x;
   Mat newGraphic = Mat::zeros(h, w, this->graphic.type());
 
-  #ifdef DEBUG
-  cout << "Appearance recentering : " << bound << " => " << newBound << endl;
-  #endif
+  AAM_LOG(Verbose) << "Appearance recentering : " << bound << " => " << newBound;
 
   this->graphic(bound).copyTo(newGraphic(newBound));
   swap(this->graphic, newGraphic);
@@ -186,9 +212,7 @@ void Appearance::resizeTo(double newScale)
   double originalScale = this->mesh.getScale();
   double ratio = newScale / originalScale;
 
-  #ifdef DEBUG
-  cout << "Appearance::resizeTo : from " << originalScale << " -> " << newScale << " (scale = " << ratio << ")" << endl;
-  #endif
+  AAM_LOG(Verbose) << "Appearance::resizeTo : from " << originalScale << " -> " << newScale << " (scale = " << ratio << ")";
 
   // Resize shape without translation
   this->mesh = MeshShape(this->mesh * ratio);
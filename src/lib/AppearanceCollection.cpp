@@ -3,24 +3,29 @@
 AppearanceCollection::AppearanceCollection(const vector<Appearance*>& apps)
 : ModelCollection()
 {
-  vector<BaseModel*> vs;
+  this->items.reserve(apps.size());
   for (auto app : apps)
   {
-    this->items.push_back(new Appearance(*app));
+    this->items.emplace_back(app);
   }
 }
 
 AppearanceCollection::AppearanceCollection(const AppearanceCollection& original)
-: ModelCollection()
+: ModelCollection(), photometricMode(original.photometricMode)
 {
-  for (auto model : original.items)
+  this->items.reserve(original.items.size());
+  for (auto& model : original.items)
   {
-    auto app = dynamic_cast<Appearance*>(model);
-    BaseModel* cloned = new Appearance(*app);
-    this->items.push_back(cloned);
+    this->items.push_back(model->clone());
   }
 }
 
+int AppearanceCollection::channels() const
+{
+  if (this->items.empty()) return 3;
+  return static_cast<const Appearance*>(this->items[0].get())->channels();
+}
+
 Mat AppearanceCollection::toMat() const
 {
   // Each element has to have equal boundary
@@ -33,7 +38,7 @@ Mat AppearanceCollection::toMat() const
   Mat m = Mat(N, M, type);
 
   int j = 0;
-  for (auto item : this->items)
+  for (auto& item : this->items)
   {
     item->toRowVector().row(0).copyTo(m.row(j));
     ++j;
@@ -43,16 +48,39 @@ Mat AppearanceCollection::toMat() const
 
 Mat AppearanceCollection::toMatReduced(int maxDimension) const
 {
+  TRACE_SCOPE("AppearanceCollection::toMatReduced");
   int N = this->items.size();
   Mat m = Mat(N, maxDimension, CV_64FC1);
 
-  int j = 0;
-  for (auto item : this->items)
+  // Each sample fills its own row
+  parallel_for_(Range(0, N), [&](const Range& r)
   {
-    Appearance* app = dynamic_cast<Appearance*>(item);
-    app->toRowVectorReduced(maxDimension).row(0).copyTo(m.row(j));
-    ++j;
-  }
+    for (int j=r.start; j<r.end; j++)
+    {
+      auto app = static_cast<const Appearance*>(this->items[j].get());
+      app->toRowVectorReduced(maxDimension, m.row(j));
+    }
+  });
+  return m;
+}
+
+/**
+ * Shape-normalised vectors, one row per sample
+ */
+Mat AppearanceCollection::toMat(const ReferenceFrame& frame) const
+{
+  TRACE_SCOPE("AppearanceCollection::toMat(frame)");
+  int N = this->items.size();
+  Mat m = Mat(N, frame.dimension(), CV_64FC1);
+
+  parallel_for_(Range(0, N), [&](const Range& r)
+  {
+    for (int j=r.start; j<r.end; j++)
+    {
+      auto app = static_cast<const Appearance*>(this->items[j].get());
+      frame.toVector(*app, m.row(j));
+    }
+  });
   return m;
 }
 
@@ -66,14 +94,12 @@ Mat AppearanceCollection::covariance(const BaseModel* mean) const
   Mat cov = Mat::zeros(M, M, CV_64FC1);
 
   int n = 0;
-  for (auto item : this->items)
+  for (auto& item : this->items)
   {
-    #ifdef DEBUG
-    cout << "... cov #" << n << " of " << N << endl;
+    AAM_LOG(Verbose) << "... cov #" << n << " of " << N;
     n++;
-    #endif
 
-    auto app = static_cast<Appearance*>(item);
+    auto app = static_cast<Appearance*>(item.get());
     auto res = app->toRowVector() - meanVector;
 
     cov = cov + res * res.t();
@@ -83,87 +109,85 @@ Mat AppearanceCollection::covariance(const BaseModel* mean) const
 
 unique_ptr<ModelCollection> AppearanceCollection::resizeTo(double newScale) const
 {
-  vector<Appearance*> newApps;
-  for (auto iter : this->items)
-  {
-    Appearance* app = dynamic_cast<Appearance*>(iter);
-    Appearance* newApp = new Appearance(*app);
-    newApp->resizeTo(newScale);
-    newApps.push_back(newApp);
-  }
+  unique_ptr<AppearanceCollection> resized(new AppearanceCollection(*this));
+  resized->resize(newScale);
+  return move(resized);
+}
 
-  unique_ptr<ModelCollection> ptr(new AppearanceCollection(newApps));
-  return ptr;
+void AppearanceCollection::resize(double newScale)
+{
+  TRACE_SCOPE("AppearanceCollection::resize");
+  parallel_for_(Range(0, this->size()), [&](const Range& r)
+  {
+    for (int n=r.start; n<r.end; n++)
+    {
+      static_cast<Appearance*>(this->items[n].get())->resizeTo(newScale);
+    }
+  });
 }
 
 unique_ptr<ModelCollection> AppearanceCollection::toShapeCollection() const
 {
-  vector<Shape*> listShapes;
-  for (auto iter : this->items)
+  vector<unique_ptr<BaseModel>> listShapes;
+  listShapes.reserve(this->items.size());
+  for (auto& item : this->items)
   {
-    Appearance* app = dynamic_cast<Appearance*>(iter);
-    auto shape = app->getShape();
-    listShapes.push_back(new MeshShape(shape));
+    Appearance* app = dynamic_cast<Appearance*>(item.get());
+    listShapes.emplace_back(new MeshShape(app->getShape()));
   }
 
-  unique_ptr<ModelCollection> ptr(new ShapeCollection(listShapes));
+  unique_ptr<ModelCollection> ptr(new ShapeCollection(move(listShapes)));
   return ptr;
 }
 
 void AppearanceCollection::normaliseRotation()
 {
-  #ifdef DEBUG
-  cout << "AppearanceCollection::normaliseRotation"  << endl;
-  #endif
+  AAM_LOG(Debug) << "AppearanceCollection::normaliseRotation";
 
   // Find the shape with neutral rotation
   auto shapes = this->toShapeCollection();
   shapes->normaliseRotation();
-  vector<BaseModel*> items = shapes->getItems();
 
   // NOTE: The items are stored as [[Shape]], instead of expected [[MeshShape]]
   // so we have to create a new mesh shape on it manually
-  auto mean = dynamic_cast<Shape*>(items.front()); // TAOTOREVIEW: Find out why [[MeshShape]] doesn't work properly
+  auto mean = dynamic_cast<Shape*>(shapes->at(0)); // TAOTOREVIEW: Find out why [[MeshShape]] doesn't work properly
   MeshShape neutralShape(*mean);
 
   // Then align the texture part onto the neutral shape
-  #ifdef DEBUG
-  cout << "Re-aligning appearance texture onto normalised shape" << endl;
-  #endif
+  AAM_LOG(Debug) << "Re-aligning appearance texture onto normalised shape";
 
-  vector<Appearance*> alignedAppearances;
-  int N = shapes->size();
-  for (int n=0; n<N; n++)
+  // Samples are warped independently, the neutral shape is only read
+  // and each worker only writes into the samples of its range
+  TRACE_SCOPE("AppearanceCollection::normaliseRotation");
+  parallel_for_(Range(0, this->size()), [&](const Range& r)
   {
-    Appearance* original = static_cast<Appearance*>(this->items[n]);
-    original->realignTo(neutralShape);    
-  }
+    for (int n=r.start; n<r.end; n++)
+    {
+      Appearance* original = static_cast<Appearance*>(this->items[n].get());
+      original->realignTo(neutralShape);
+    }
+  });
 }
 
 double AppearanceCollection::sumProcrustesDistance(const BaseModel* targetModel) const
 {
-  #ifdef DEBUG
-  cout << "AppearanceCollection::sumProcrustesDistance" << endl;
-  #endif
-
-  // TAOTOREVIEW:
+  AAM_LOG(Debug) << "AppearanceCollection::sumProcrustesDistance";
+  return ModelCollection::sumProcrustesDistance(targetModel);
 }
 
 ModelPCA* AppearanceCollection::pca(const BaseModel* mean, int maxDimension) const
 {
-  #ifdef DEBUG
-  cout << GREEN << "[Computing Appearance::PCA]" << RESET << endl;
-  #endif
+  AAM_LOG(Info) << GREEN << "[Computing Appearance::PCA]" << RESET;
 
   // Reduce the size of the texture
   auto meanApp   = dynamic_cast<const Appearance*>(mean);
   Mat meanVector = meanApp->toRowVectorReduced(maxDimension);
   Mat data       = this->toMatReduced(maxDimension);
+  auto photometric = this->normalisePhotometry(data);
+  photometric.normalise(meanVector);
 
-  #ifdef DEBUG
-  cout << "... mean model size : " << meanVector.size() << endl;
-  cout << "... data size       : " << data.size() << endl;
-  #endif
+  AAM_LOG(Debug) << "... mean model size : " << meanVector.size();
+  AAM_LOG(Debug) << "... data size       : " << data.size();
 
   auto pca = PCA(data, meanVector, cv::PCA::DATA_AS_ROW);
   
@@ -171,28 +195,59 @@ ModelPCA* AppearanceCollection::pca(const BaseModel* mean, int maxDimension) con
   // Mat paddedEigenVectors = Mat::zeros(maxDimension, maxDimension, CV_64FC1);
   // pca.eigenvectors.copyTo(paddedEigenVectors);
   
-  #ifdef DEBUG
-  cout << "... eigenvalues  : " << pca.eigenvalues.size() << endl;
-  cout << "... eigenvectors : " << pca.eigenvectors.size() << endl;
-  #endif
+  AAM_LOG(Debug) << "... eigenvalues  : " << pca.eigenvalues.size();
+  AAM_LOG(Debug) << "... eigenvectors : " << pca.eigenvectors.size();
 
   // Compose a shape param set from eigenvalues
   auto size = meanApp->getSize();
-  return new AppearanceModelPCA(pca, meanApp->getShape(), size);
+  auto pcaAppearance = new AppearanceModelPCA(pca, meanApp->getShape(), size, meanApp->channels());
+  pcaAppearance->setPhotometric(photometric);
+  return pcaAppearance;
 }
 
-unique_ptr<ModelCollection> AppearanceCollection::clone() const
+/**
+ * PCA of the samples warped onto [frame], the mean is taken over the
+ * warped samples so no separate mean appearance is required
+ */
+ModelPCA* AppearanceCollection::pca(const ReferenceFrame& frame) const
+{
+  AAM_LOG(Info) << GREEN << "[Computing Appearance::PCA in reference frame]" << RESET;
+
+  assert(this->channels() == frame.getChannels());
+  Mat data = this->toMat(frame);
+  auto photometric = this->normalisePhotometry(data);
+  AAM_LOG(Debug) << "... data size       : " << data.size();
+
+  auto pca = PCA(data, Mat(), cv::PCA::DATA_AS_ROW);
+
+  AAM_LOG(Debug) << "... eigenvalues  : " << pca.eigenvalues.size();
+  AAM_LOG(Debug) << "... eigenvectors : " << pca.eigenvectors.size();
+
+  auto pcaAppearance = new AppearanceModelPCA(pca, frame);
+  pcaAppearance->setPhotometric(photometric);
+  return pcaAppearance;
+}
+
+/**
+ * Normalise the brightness and contrast of each row of [data] in place,
+ * the normaliser is returned so the same mapping applies when fitting
+ */
+PhotometricNormaliser AppearanceCollection::normalisePhotometry(Mat& data) const
 {
-  #ifdef DEBUG
-  cout << "BaseModelAppearanceCollection::clone @" << getUID() << endl;
-  #endif
-  vector<BaseModel*> vs;
-  for (auto model : this->items)
+  PhotometricNormaliser photometric(this->photometricMode, this->channels());
+  if (!photometric.isEnabled()) return photometric;
+
+  photometric.train(data);
+  for (int j=0; j<data.rows; j++)
   {
-    auto app = dynamic_cast<Appearance*>(model);
-    BaseModel* cloned = new Appearance(*app);
-    vs.push_back(cloned);
+    photometric.normalise(data.row(j));
   }
-  unique_ptr<ModelCollection> newSet(new AppearanceCollection(vs));
+  return photometric;
+}
+
+unique_ptr<ModelCollection> AppearanceCollection::clone() const
+{
+  AAM_LOG(Verbose) << "BaseModelAppearanceCollection::clone @" << getUID();
+  unique_ptr<ModelCollection> newSet(new AppearanceCollection(*this));
   return newSet;
-}
\ No newline at end of file
+}
@@ -0,0 +1,34 @@
+#include "FaceLocaliser.h"
+
+HaarBasedFaceLocaliser::HaarBasedFaceLocaliser(
+  const string& cascadePath,
+  double scaleFactor,
+  int minNeighbours,
+  Size minSize)
+: scaleFactor(scaleFactor), minNeighbours(minNeighbours), minSize(minSize)
+{
+  if (!this->cascade.load(cascadePath))
+  {
+    AAM_LOG(Error) << RED << "Unable to load face cascade : " << cascadePath << RESET;
+  }
+}
+
+vector<Rect> HaarBasedFaceLocaliser::find(Mat im) const
+{
+  vector<Rect> faces;
+  if (!isLoaded()) return faces;
+
+  Mat gray;
+  if (im.channels() == 1) equalizeHist(im, gray);
+  else
+  {
+    cvtColor(im, gray, COLOR_BGR2GRAY);
+    equalizeHist(gray, gray);
+  }
+
+  this->cascade.detectMultiScale(
+    gray, faces, this->scaleFactor, this->minNeighbours, 0, this->minSize);
+
+  AAM_LOG(Debug) << "HaarBasedFaceLocaliser : " << faces.size() << " faces found";
+  return faces;
+}
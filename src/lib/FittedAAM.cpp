@@ -1,5 +1,85 @@
 #include "FittedAAM.h"
 
+namespace
+{
+  struct ErrorOptions
+  {
+    int stride;
+    double budget;   // Squared error beyond which the measurement stops
+    bool gainBias;   // Solve the photometric gain and bias of the sample
+    bool perChannel; // ... for each channel separately
+  };
+
+  /**
+   * Squared error between [overlay] and [sample] inside [mask],
+   * accumulated in bands of rows so the measurement stops early
+   * once the budget is exceeded. [e0] receives the error against
+   * a black (or with gain and bias, a flat) sample.
+   */
+  template<int CN> struct MeasureError
+  {
+    static double run(const Mat& overlay, const Mat& sample, const Mat& mask, const ErrorOptions& opts, double& e0)
+    {
+      typedef typename PixelOf<CN>::type Pixel;
+      const int BAND_ROWS = 8;
+      const double W = (CN == 3) ? 0.33 : 1.0/CN; // ~ mean over the channels
+      const int stride = opts.stride;
+      GainBiasFit fits[CN];
+
+      double e = 0;
+      e0 = 0;
+      for (int j0=0; j0<mask.rows; j0 += BAND_ROWS * stride)
+      {
+        int j1 = min(mask.rows, j0 + BAND_ROWS * stride);
+        for (int j=j0; j<j1; j += stride)
+        {
+          const unsigned char* m = mask.ptr<unsigned char>(j);
+          const Pixel* o = overlay.ptr<Pixel>(j);
+          const Pixel* p = sample.ptr<Pixel>(j);
+          for (int i=0; i<mask.cols; i += stride)
+          {
+            if (m[i] == 0) continue;
+            if (opts.gainBias)
+            {
+              for (int c=0; c<CN; c++)
+                fits[opts.perChannel ? c : 0].add(channelOf<CN>(o[i], c), channelOf<CN>(p[i], c));
+            }
+            else
+            {
+              int d = 0, d0 = 0;
+              for (int c=0; c<CN; c++)
+              {
+                int oc = channelOf<CN>(o[i], c);
+                d  += abs(oc - channelOf<CN>(p[i], c));
+                d0 += oc;
+              }
+              e += Aux::square(W*d);
+              e0 += Aux::square(W*d0);
+            }
+          }
+        }
+
+        // Residuals of the rows so far, averaged over the channels.
+        // Fitted on fewer pixels, they never exceed the final residuals.
+        if (opts.gainBias)
+        {
+          e = 0;
+          e0 = 0;
+          for (int c=0; c<CN; c++)
+          {
+            e  += fits[c].residual() / CN;
+            e0 += fits[c].blankResidual() / CN;
+          }
+        }
+
+        // Early rejection
+        if (e > opts.budget) return e;
+      }
+      return e;
+    }
+  };
+}
+
 BaseFittedModel* FittedAAM::setOrigin(const Point2d& p)
 {
   this->origin = p;
@@ -29,7 +109,7 @@ Appearance* FittedAAM::toAppearance() const
   assert(this->origin.x >= 0);
   assert(this->origin.y >= 0);
 
-  auto shape = toShape();
+  unique_ptr<MeshShape> shape{ toShape() };
   auto appearance = this->pcaAppearance()
     .cloneWithNewScale(scale, origin)
     .toAppearance(appearanceParam);
@@ -76,64 +156,101 @@ Rect FittedAAM::getBound() const
   return b;
 }
 
-double FittedAAM::measureError(const Mat& sample, int skipPixels)
+/**
+ * RMSE of intensity between the model and the sample, inside the model convex.
+ * The error is accumulated in bands of rows. Once the partial error alone
+ * exceeds [rejectAbove], the measurement stops and the (lower bound) 
+ * error so far is returned, which is already greater than [rejectAbove].
+ *
+ * [sample] may be a region of a larger image, the model is then located
+ * in the coordinates of the whole image and only the region is read.
+ * If [blankError] is given, it receives the error of the model against
+ * a black sample, measured in the same pass.
+ *
+ * When the appearance model is photometrically normalised, the gain and
+ * bias of the sample are solved in closed form for each candidate,
+ * and the blank error is the one against a flat sample.
+ */
+double FittedAAM::measureError(const Mat& sample, int skipPixels, double rejectAbove, double* blankError)
 {
   // - Draw the model as overlay on black canvas
   // - Offset and rescale the overlay
   // - Crop the sample by shape boundary
   // - Measure aggregated error of intensity
+  TRACE_SCOPE("FittedAAM::measureError");
+
+  MatArena& arena = MatArena::local();
+  MatArena::Scope scope(arena);
+
+  if (blankError != nullptr) *blankError = numeric_limits<double>::max();
 
   Rect bound = getBound();
-  auto shape = toShape();
+  unique_ptr<MeshShape> shape{ toShape() };
   Mat shapeConvexOriginal = shape->convexFill();
 
+  // Offset of the sample region inside the whole image
+  Size wholeSize;
+  Point ofs;
+  sample.locateROI(wholeSize, ofs);
+
   // Find the biggest possible rectangle which is capable of containing the following:
   // - The convex fill of the shape
-  // - The sample boundary
+  // - The sample region
   // - The model boundary
-  int minX = max(0, min(bound.x, sample.cols-1));
-  int minY = max(0, min(bound.y, sample.rows-1));
-  int maxX = min(sample.cols-1, bound.x+bound.width);
-  int maxY = min(sample.rows-1, bound.y+bound.height);
+  int minX = max(ofs.x, min(bound.x, ofs.x + sample.cols-1));
+  int minY = max(ofs.y, min(bound.y, ofs.y + sample.rows-1));
+  int maxX = min(ofs.x + sample.cols-1, bound.x+bound.width);
+  int maxY = min(ofs.y + sample.rows-1, bound.y+bound.height);
   maxX = min(shapeConvexOriginal.cols-1, maxX);
   maxY = min(shapeConvexOriginal.rows-1, maxY);
+  if (maxX <= minX || maxY <= minY) return numeric_limits<double>::max();
   Rect obound(minX, minY, maxX-minX, maxY-minY);  
 
-  Mat canvas = Mat::zeros(Size(bound.x + bound.width + 1, bound.y + bound.height + 1), CV_8UC3);
+  Mat canvas = arena.zeros(Size(bound.x + bound.width + 1, bound.y + bound.height + 1), CV_8UC(this->pcaAppearance().getChannels()));
   Mat overlay = drawOverlay(canvas)(obound);
-  Mat sampleCrop = sample(obound);
-
+  Mat sampleCrop = sample(obound - ofs);
   Mat shapeConvex = shapeConvexOriginal(obound);
-  Mat shapeConvexBGR(obound.height, obound.width, CV_8UC3);
-  cvtColor(shapeConvex, shapeConvexBGR, COLOR_GRAY2BGR);
 
-  Mat diff(obound.height, obound.width, CV_8UC3);
+  const int stride = skipPixels + 1;
 
-  // Geometrically crop the diff between the sample and the overlay
-  absdiff(overlay, sampleCrop, diff);
-  bitwise_and(diff, shapeConvexBGR, diff);
-
-  // Find RMSE error
-  double e = 0;
+  // Number of sampled pixels inside the convex,
+  // known upfront so a partial sum bounds the final error from below
   double n = 0;
-  for (int i=0; i<obound.width; i += skipPixels + 1)
-    for (int j=0; j<obound.height; j += skipPixels + 1)
-    {
-      if (shapeConvex.at<unsigned char>(j,i) > 0)
-      {
-        auto d = diff.at<Vec3b>(j,i);
-        e += Aux::square(0.33*(d[0] + d[1] + d[2]));
-        n += 1;
-      }
-    }
-  e = (n == 0) ? numeric_limits<double>::max() : Aux::sqrt(e/n);
-  return e;
+  for (int j=0; j<obound.height; j += stride)
+  {
+    const unsigned char* mask = shapeConvex.ptr<unsigned char>(j);
+    for (int i=0; i<obound.width; i += stride)
+      if (mask[i] > 0) n += 1;
+  }
+  if (n == 0) return numeric_limits<double>::max();
+
+  // Squared error budget, beyond which the candidate is rejected
+  const double budget = (rejectAbove < numeric_limits<double>::max()) 
+    ? Aux::square(rejectAbove) * n
+    : numeric_limits<double>::max();
+
+  // With photometric normalisation, the sample is compared after
+  // the gain and bias which best map it onto the model
+  const PhotometricNormaliser& photometric = this->pcaAppearance().getPhotometric();
+  ErrorOptions opts{
+    stride, budget,
+    photometric.isEnabled(),
+    photometric.getMode() == PHOTOMETRIC_PER_CHANNEL };
+
+  assert(sampleCrop.channels() == overlay.channels());
+  double e0 = 0;
+  double e = dispatchChannels<MeasureError>(
+    overlay.channels(), overlay, sampleCrop, shapeConvex, opts, e0);
+  if (e > budget) return std::sqrt(e/n);
+
+  if (blankError != nullptr) *blankError = Aux::sqrt(e0/n);
+  return Aux::sqrt(e/n);
 }
 
 Mat FittedAAM::drawOverlay(Mat& canvas, bool withEdges)
 {
   IO::MatIO m;
-  Appearance* app = this->toAppearance();
+  unique_ptr<Appearance> app{ this->toAppearance() };
   
   Mat gr = app->getGraphic();
   auto size = app->getShape().getBound();
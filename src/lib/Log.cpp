@@ -0,0 +1,22 @@
+#include "Log.h"
+#include <mutex>
+
+namespace Log
+{
+  std::atomic<int> runtimeLevel(Info);
+
+  static std::mutex& outputLock()
+  {
+    static std::mutex m;
+    return m;
+  }
+
+  Line::~Line()
+  {
+    this->buffer << '\n';
+    std::lock_guard<std::mutex> guard(outputLock());
+    std::ostream& out = (this->level <= Warn) ? std::cerr : std::cout;
+    out << this->buffer.str();
+    out.flush();
+  }
+}
@@ -79,10 +79,8 @@ const int MeshShape::findIndex(const Point2d& p) const
         return j;
       }
   }
-  #ifdef DEBUG
-  cout << RED << p << " can't be located in the following Matrix" << RESET << endl;
-  cout << this->mat << endl;
-  #endif
+  AAM_LOG(Error) << RED << p << " can't be located in the following Matrix" << RESET;
+  AAM_LOG(Error) << this->mat;
   throw new domain_error("The point is not locatable inside the current shape");
 }
 
@@ -138,6 +136,8 @@ void MeshShape::repopulateCache()
 
 Mat MeshShape::render(IO::GenericIO* io, Mat background, double scaleFactor, Point2d recentre) const
 {
+  if (IO::isHeadless(io)) return background;
+
   // TAOREVIEW: Utilise OpenGL
   auto triangles = this->getTriangles();
   Size size = background.size();
@@ -146,9 +146,7 @@ Mat MeshShape::render(IO::GenericIO* io, Mat background, double scaleFactor, Poi
 
   auto hull = this->convexHull();
 
-  #ifdef DEBUG
-  cout << "MeshShape::render : num triangles = " << triangles.size() << endl;
-  #endif
+  AAM_LOG(Verbose) << "MeshShape::render : num triangles = " << triangles.size();
 
   // Render edges
   for (auto tr : triangles)
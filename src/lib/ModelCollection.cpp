@@ -5,38 +5,51 @@ long long ModelCollection::generateUID()
   return static_cast<long long>(floor(time(NULL)));
 }
 
+ModelCollection::ModelCollection(const vector<BaseModel*>& vs)
+: uid(ModelCollection::generateUID())
+{
+  this->items.reserve(vs.size());
+  for (auto item : vs)
+  {
+    this->items.emplace_back(item);
+  }
+}
+
 ModelCollection::~ModelCollection()
 {
-  #ifdef DEBUG 
-  auto cnt = fmt::format("({0} items)", this->items.size());
-  cout << YELLOW << "Cleaning up ModelCollection @" << getUID() << cnt  << RESET << endl;
-  #endif
+  AAM_LOG(Verbose) << YELLOW << "Cleaning up ModelCollection @" << getUID() 
+    << fmt::format("({0} items)", this->items.size()) << RESET;
 
   clear();
 
-  #ifdef DEBUG
-  cout << "... ModelCollection @" << getUID() << " cleared and destroyed." << endl;
-  #endif
+  AAM_LOG(Verbose) << "... ModelCollection @" << getUID() << " cleared and destroyed.";
 }
 
 void ModelCollection::clear()
 {
-  #ifdef DEBUG
-  cout << YELLOW << "BaseModelModelCollection::clear @" << getUID() << RESET << endl;
-  #endif
-  for (auto item : this->items)
+  AAM_LOG(Verbose) << YELLOW << "BaseModelModelCollection::clear @" << getUID() << RESET;
+  this->items.clear();
+}
+
+const vector<BaseModel*> ModelCollection::getItems() const
+{
+  vector<BaseModel*> vs;
+  vs.reserve(this->items.size());
+  for (auto& item : this->items)
   {
-    delete item;
+    vs.push_back(item.get());
   }
+  return vs;
 }
 
 
-BaseModel* ModelCollection::procrustesMean(double tol, int maxIter)
+/**
+ * Align the items onto each other in place,
+ * and return a copy of the resultant mean model
+ */
+unique_ptr<BaseModel> ModelCollection::procrustesMean(double tol, int maxIter)
 {
-  #ifdef DEBUG
-  cout << "BaseModelModelCollection::procrustesMean @" << getUID() << endl;
-  #endif
-  auto alignedSet  = this->clone();
+  AAM_LOG(Debug) << "BaseModelModelCollection::procrustesMean @" << getUID();
   double lastError = 0;
   double tl        = numeric_limits<double>::max();
   int iter         = 0;
@@ -48,26 +61,22 @@ BaseModel* ModelCollection::procrustesMean(double tol, int maxIter)
 
   while (tl > tol && iter < maxIter)
   {
-    alignedSet->normaliseRotation();
-    auto mean  = alignedSet->items[0];
-    double err = alignedSet->sumProcrustesDistance(mean);
+    this->normaliseRotation();
+    auto mean  = this->items[0].get();
+    double err = this->sumProcrustesDistance(mean);
 
     iter++;
     tl = tolerance(err, lastError);
     lastError = err;
   }
-  
-  auto meanModel = alignedSet->items[0];
-
-  swap(this->items, alignedSet->items);
 
-  return meanModel;
+  return this->items[0]->clone();
 }
 
 double ModelCollection::sumProcrustesDistance(const BaseModel* targetModel) const
 {
   double sumDist = 0.0;
-  for (auto model : this->items)
+  for (auto& model : this->items)
   {
     sumDist += model->procrustesDistance(targetModel);
   }
@@ -84,7 +93,7 @@ Mat ModelCollection::covariance(const BaseModel* mean) const
   int N = this->items[0]->getMat().rows;
   Mat cov = Mat::zeros(N, N, CV_64FC1);
   double M = 0;
-  for (auto model : this->items)
+  for (auto& model : this->items)
   {
     auto res = model->getMat() - mean->getMat();
     cov = cov + res * res.t();
@@ -98,27 +107,21 @@ Mat ModelCollection::covariance(const BaseModel* mean) const
  */
 ModelPCA* ModelCollection::pca(const BaseModel* mean, int maxDimension) const
 {
-  #ifdef DEBUG
-  cout << GREEN << "[Computing PCA]" << RESET << endl;
-  #endif
+  AAM_LOG(Info) << GREEN << "[Computing PCA]" << RESET;
 
   Mat meanVector = mean->toRowVector();
   Mat data       = this->toMat();
 
-  #ifdef DEBUG
-  cout << "... mean model size : " << meanVector.size() << endl;
-  cout << "... data size       : " << data.size() << endl;
-  #endif
+  AAM_LOG(Debug) << "... mean model size : " << meanVector.size();
+  AAM_LOG(Debug) << "... data size       : " << data.size();
 
   auto pca = PCA(data, meanVector, cv::PCA::DATA_AS_ROW);
 
   // Collect lambdas
   // TAOTOREVIEW: Take only highest K lambda where K<N
   
-  #ifdef DEBUG
-  cout << "... eigenvalues  : " << pca.eigenvalues.size() << endl;
-  cout << "... eigenvectors : " << pca.eigenvectors.size() << endl;
-  #endif
+  AAM_LOG(Debug) << "... eigenvalues  : " << pca.eigenvalues.size();
+  AAM_LOG(Debug) << "... eigenvectors : " << pca.eigenvectors.size();
 
   // Create a Shape model PCA by default
   return new ShapeModelPCA(pca);
@@ -9,6 +9,7 @@ ostream &operator<<(ostream &os, SearchWith const &s)
     case TRANSLATION: str = "TRANSLATION"; break;
     case RESHAPING: str = "RESHAPING"; break;
     case REAPPEARANCING: str = "REAPP"; break;
+    case COMBINED: str = "COMBINED"; break;
   }
   return os << str;
 }
@@ -21,76 +22,113 @@ ostream &operator<<(ostream &os, FittingCriteria const &c)
     << "...num models to gen = " << c.numModelsToGeneratePerIter << endl
     << "...min err diff = " << c.minErrorImprovement << endl
     << "...init scale = " << c.initScale << endl
-    << "...init pos = " << c.initPos << endl;
+    << "...init pos = " << c.initPos << endl
+    << "...early rejection = " << c.earlyRejection << endl
+    << "...combined search = " << c.combinedSearch << endl
+    << "...coarse search = " << c.coarseSearch << " (" << c.coarseScaleSteps << " scales)" << endl;
+}
+
+/**
+ * Measure a candidate and keep it in the buffer
+ * if it explains the sample better than a blank one.
+ * Only the search region of the sample is read.
+ * With early rejection, the measurement is cut short as soon as the candidate
+ * is known to be worse than the last one which would survive into the beam,
+ * and worse than its parent, so the acceptance counted for the step
+ * scheduler does not depend on the rejection.
+ */
+void ModelFitter::evaluateCandidate(unique_ptr<BaseFittedModel>& candidate, double parentError)
+{
+  const int SKIP_SIZE = 2;
+  double threshold = crit.earlyRejection
+    ? max(buffer.valueAt(crit.numModelsToGeneratePerIter - 1), parentError)
+    : numeric_limits<double>::max();
+
+  ++numEvaluated;
+  TRACE_COUNT("fitter.candidates.evaluated", 1);
+  double e0;
+  double e = candidate->measureError(roiSample, SKIP_SIZE, threshold, &e0);
+  if (e > threshold)
+  {
+    ++numRejectedEarly;
+    TRACE_COUNT("fitter.candidates.rejectedEarly", 1);
+    pool.release(candidate);
+    return;
+  }
+
+  if (e < parentError)
+  {
+    ++numAccepted;
+    TRACE_COUNT("fitter.candidates.accepted", 1);
+  }
+  if (e<e0)
+  {
+    buffer.push(candidate, e);
+    TRACE_COUNT("fitter.candidates.buffered", 1);
+  }
+  else pool.release(candidate);
 }
 
 void ModelFitter::iterateModelExpansion(
   ModelList* const modelPtr,
   SearchWith action,
-  double scale)
+  double step)
 {
   assert(modelPtr != nullptr);
   assert(modelPtr->ptr != nullptr);
 
-  // Generate action params
-  auto pcaShape      = aamPCA->getShapePCA();
-  auto pcaAppearance = aamPCA->getAppearancePCA();
-  double scales[]    = {1.01, 0.99, 1.0, 1.5, 0.5};
-  Point2d trans[]    = {Point2d(-1,0), Point2d(0,-1), 
-                        Point2d(1,0), Point2d(0,1),
-                        Point2d(1,1), Point2d(1,-1),
-                        Point2d(-1,1), Point2d(-1,-1),
-                        Point2d(0,0)
-                      };
-  
-  int smatSize = pcaShape.getSizeOfPermutationOfParams();
-  int amatSize = pcaAppearance.getSizeOfPermutationOfParams();
-  Mat *smat = new Mat[smatSize]; 
-  Mat *amat = new Mat[amatSize];
-  for (int i=0; i<smatSize; i++) smat[i] = Mat::zeros(1, pcaShape.dimension(), CV_64FC1);
-  for (int i=0; i<amatSize; i++) amat[i] = Mat::zeros(1, pcaAppearance.dimension(), CV_64FC1);
-  pcaShape.permutationOfParams(smat);
-  pcaAppearance.permutationOfParams(amat);
+  // Perturbations are read from the precomputed table
+  const auto& scales = table->getScales();
+  const auto& trans  = table->getTranslations();
+  const auto& smat   = table->getShapeParams();
+  const auto& amat   = table->getAppearanceParams();
+  const auto& cmat   = table->getCombinedParams();
+  int smatSize       = smat.size();
+  int amatSize       = amat.size();
+  int cmatSize       = cmat.size();
+  int shapeDim       = aamPCA->dimensionShape();
+  int appearanceDim  = aamPCA->dimensionAppearance();
+  const BaseFittedModel* parent = modelPtr->ptr.get();
+  double parentError = modelPtr->v;
+
+  // Scratch memory for the candidate parameters, recycled per candidate
+  MatArena& arena = MatArena::local();
 
-  const int SKIP_SIZE = 2;
   #define IN_RANGE(v,_min,_max) (v>_min && v<_max)
 
-  // Generate new model by varying the parameter
+  // Generate new model by varying the parameter,
+  // the perturbation is attenuated by the step multiplier of the action.
   // NOTE: A new model may be ignored if it does not produce smaller error than base minimum.
   switch (action)
   {
     case SCALING:
-      for (auto& s : scales) 
+      for (auto s : scales) 
       {
         TRY
-        auto ptrModel = modelPtr->ptr->clone();
-        double newScale = s * modelPtr->ptr->scale * scale;
+        double newScale = parent->scale * (1 + (s - 1) * step);
         if (newScale > 0 && newScale >= crit.minScale 
           && newScale <= crit.maxScale
           && IN_RANGE(newScale, SCALING_MIN, SCALING_MAX))
         {
+          auto ptrModel = pool.acquire(*parent);
           ptrModel->setScale(newScale);
-          double e = ptrModel->measureError(sample, SKIP_SIZE);
-          double e0 = ptrModel->measureError(zero, SKIP_SIZE);
-          if (e<e0) buffer.push(ptrModel, e);
+          evaluateCandidate(ptrModel, parentError);
         }
         END_TRY
       }
       break;
 
     case TRANSLATION:
-      for (auto& t : trans)
+      for (auto t : trans)
       {
         TRY
-        auto ptrModel = modelPtr->ptr->clone();
-        auto newOrigin = modelPtr->ptr->origin + t * scale;
+        auto newOrigin = parent->origin + t * step;
         if (newOrigin.x >= 0 && newOrigin.y >= 0 
-          && IN_RANGE(t.x * scale, TRANSLATION_MIN, TRANSLATION_MAX))
+          && IN_RANGE(t.x * step, TRANSLATION_MIN, TRANSLATION_MAX))
         {
+          auto ptrModel = pool.acquire(*parent);
           ptrModel->setOrigin(newOrigin);
-          double e = ptrModel->measureError(sample, SKIP_SIZE);
-          double e0 = ptrModel->measureError(zero, SKIP_SIZE);
-          if (e<e0) buffer.push(ptrModel, e);
+          evaluateCandidate(ptrModel, parentError);
         }
         END_TRY
       }
@@ -100,16 +138,16 @@ void ModelFitter::iterateModelExpansion(
       for (int i=0; i<smatSize; i++)
       {
         TRY
-        auto ptrModel = modelPtr->ptr->clone();
-        Mat param = modelPtr->ptr->shapeParam * scale + smat[i];
+        MatArena::Scope scope(arena);
+        Mat param = arena.acquire(1, shapeDim, CV_64FC1);
+        param = parent->shapeParam + smat[i] * step;
         double _mi, _mx;
         minMaxLoc(param, &_mi, &_mx);
         if (_mi > RESHAPING_MIN && _mx < RESHAPING_MAX)
         {
+          auto ptrModel = pool.acquire(*parent);
           ptrModel->setShapeParam(param);
-          double e = ptrModel->measureError(sample, SKIP_SIZE);
-          double e0 = ptrModel->measureError(zero, SKIP_SIZE);
-          if (e<e0) buffer.push(ptrModel, e);
+          evaluateCandidate(ptrModel, parentError);
         }
         END_TRY
       }
@@ -119,28 +157,55 @@ void ModelFitter::iterateModelExpansion(
       for (int i=0; i<amatSize; i++)
       {
         TRY
-        auto ptrModel = modelPtr->ptr->clone();
-        Mat param = modelPtr->ptr->appearanceParam * scale + amat[i];
+        MatArena::Scope scope(arena);
+        Mat param = arena.acquire(1, appearanceDim, CV_64FC1);
+        param = parent->appearanceParam + amat[i] * step;
         double _mi, _mx;
         minMaxLoc(param, &_mi, &_mx);
         if (_mi > REAPPEARANCING_MIN && _mx < REAPPEARANCING_MAX)
         {
+          auto ptrModel = pool.acquire(*parent);
           ptrModel->setAppearanceParam(param);
-          double e = ptrModel->measureError(sample, SKIP_SIZE);
-          double e0 = ptrModel->measureError(zero, SKIP_SIZE);
-          if (e<e0) buffer.push(ptrModel, e);
+          evaluateCandidate(ptrModel, parentError);
         }
         END_TRY
       }
       break;
-  }
 
-  delete[] smat;
-  delete[] amat;
+    case COMBINED:
+      {
+        // Vary shape and appearance together along the joint components.
+        // The perturbation is added to the parent's own parameters rather than
+        // to its projection onto the combined subspace, which only retains
+        // part of the variance, so a zero step leaves the parent unchanged.
+        const auto& pcaCombined = aamPCA->getCombinedPCA();
+        for (int i=0; i<cmatSize; i++)
+        {
+          TRY
+          Mat sdelta, adelta;
+          pcaCombined.toShapeAndAppearanceDeltas(cmat[i] * step, sdelta, adelta);
+          Mat sparam = parent->shapeParam + sdelta;
+          Mat aparam = parent->appearanceParam + adelta;
+          double _smi, _smx, _ami, _amx;
+          minMaxLoc(sparam, &_smi, &_smx);
+          minMaxLoc(aparam, &_ami, &_amx);
+          if (_smi > RESHAPING_MIN && _smx < RESHAPING_MAX &&
+              _ami > REAPPEARANCING_MIN && _amx < REAPPEARANCING_MAX)
+          {
+            auto ptrModel = pool.acquire(*parent);
+            ptrModel->setShapeParam(sparam);
+            ptrModel->setAppearanceParam(aparam);
+            evaluateCandidate(ptrModel, parentError);
+          }
+          END_TRY
+        }
+      }
+      break;
+  }
 
   // Repeat until the model pointer reaches the end
   if (modelPtr->next != nullptr && modelPtr->next->ptr != nullptr)
-    iterateModelExpansion(modelPtr->next.get(), action, scale);
+    iterateModelExpansion(modelPtr->next.get(), action, step);
 }
 
 void ModelFitter::transferFromBuffer(int nLeft)
@@ -161,106 +226,245 @@ void ModelFitter::transferFromBuffer(int nLeft)
   }
 }
 
+/**
+ * Global search of the position and scale of [model] over the whole sample.
+ * At each scale of a geometric grid, the overlay of the model is slid
+ * across the sample in a single (masked) template matching pass.
+ * The position and scale with the smallest mean squared error are kept.
+ */
+void ModelFitter::coarseSearch(unique_ptr<BaseFittedModel>& model) const
+{
+  TRACE_SCOPE("ModelFitter::coarseSearch");
+
+  const int N = max(1, crit.coarseScaleSteps);
+  double bestError = numeric_limits<double>::max();
+  Point2d bestOrigin = model->origin;
+  double bestScale = model->scale;
+
+  auto probe = model->clone();
+  probe->setOrigin(0, 0);
+  for (int k=0; k<N; k++)
+  {
+    double s = (N == 1) 
+      ? model->scale 
+      : crit.minScale * pow(crit.maxScale / crit.minScale, k / (double)(N-1));
+    probe->setScale(s);
+
+    // Template : the model overlay cropped to its boundary,
+    // masked by its convex (weights of 0 or 1)
+    Rect bound = probe->getBound();
+    unique_ptr<MeshShape> shape{ probe->toShape() };
+    Mat convex = shape->convexFill();
+    Mat canvas = Mat::zeros(Size(bound.x + bound.width + 1, bound.y + bound.height + 1), sample.type());
+    Mat overlay = probe->drawOverlay(canvas);
+    Rect t = bound 
+      & Rect(0, 0, overlay.cols, overlay.rows) 
+      & Rect(0, 0, convex.cols, convex.rows);
+    if (t.area() == 0 || t.width > sample.cols || t.height > sample.rows)
+      continue;
+
+    Mat mask = (convex(t) > 0) / 255;
+    double n = countNonZero(mask);
+    if (n == 0) continue;
+    vector<Mat> masks(sample.channels(), mask);
+    Mat maskCN;
+    merge(masks, maskCN);
+
+    Mat result;
+    matchTemplate(sample, overlay(t), result, TM_SQDIFF, maskCN);
+    double minVal;
+    Point minLoc;
+    minMaxLoc(result, &minVal, nullptr, &minLoc, nullptr);
+
+    // The template starts at [t] from the origin of the probe,
+    // a match closer to the sample edge needs an origin outside of it
+    double e = minVal / n;
+    Point2d origin(minLoc.x - t.x, minLoc.y - t.y);
+    AAM_LOG(Debug) << "... Coarse search at scale " << s << " : " << e << " @ " << origin;
+    if (origin.x < 0 || origin.y < 0)
+    {
+      AAM_LOG(Debug) << "... Skipped, origin outside of the sample";
+      continue;
+    }
+    if (e < bestError)
+    {
+      bestError = e;
+      bestScale = s;
+      bestOrigin = origin;
+    }
+  }
+
+  model->setScale(bestScale);
+  model->setOrigin(bestOrigin);
+  AAM_LOG(Debug) << "Coarse search : origin = " << bestOrigin << ", scale = " << bestScale;
+}
+
+/**
+ * Restrict the search region to the bounds of the beam, grown by
+ * how far a candidate can move from its parent within one expansion :
+ * the largest translation of the table and its largest and smallest
+ * scale factors, attenuated by the current steps of the scheduler.
+ * Every candidate then lies inside the region, and its error is
+ * measured over the whole model, comparable to the other candidates.
+ */
+void ModelFitter::updateROI()
+{
+  double stepT = this->scheduler.step(TRANSLATION);
+  double stepS = this->scheduler.step(SCALING);
+  double tx = 0, ty = 0;
+  for (auto& t : this->table->getTranslations())
+  {
+    tx = max(tx, abs(t.x) * stepT);
+    ty = max(ty, abs(t.y) * stepT);
+  }
+  double gMin = 1, gMax = 1;
+  for (auto s : this->table->getScales())
+  {
+    double g = 1 + (s - 1) * stepS;
+    gMin = min(gMin, max(g, 0.0));
+    gMax = max(gMax, g);
+  }
+
+  Rect2d region;
+  for (ModelList* node = &this->models; node != nullptr && node->ptr != nullptr; node = node->next.get())
+  {
+    Rect2d b = node->ptr->getBound();
+    Point2d o = node->ptr->origin;
+    Rect2d reach(b.x - tx, b.y - ty, b.width + 2*tx, b.height + 2*ty);
+
+    // Scaling is about the origin of the model
+    for (double g : {gMin, gMax})
+    {
+      Rect2d scaled(o.x + (b.x - o.x)*g, o.y + (b.y - o.y)*g, b.width*g, b.height*g);
+      reach |= scaled;
+    }
+    region = (region.area() == 0) ? reach : (region | reach);
+  }
+
+  Rect whole(0, 0, sample.cols, sample.rows);
+  Rect padded;
+  if (region.area() > 0)
+  {
+    int x0 = (int)floor(region.x) - ROI_MARGIN;
+    int y0 = (int)floor(region.y) - ROI_MARGIN;
+    int x1 = (int)ceil(region.x + region.width) + ROI_MARGIN;
+    int y1 = (int)ceil(region.y + region.height) + ROI_MARGIN;
+    padded = Rect(x0, y0, x1 - x0, y1 - y0) & whole;
+  }
+  if (padded.area() == 0) padded = whole;
+
+  this->roi = padded;
+  this->roiSample = this->sample(padded);
+}
+
 unique_ptr<BaseFittedModel> ModelFitter::fit(unique_ptr<BaseFittedModel>& initModel, int skipPixels)
 {
+  TRACE_SCOPE("ModelFitter::fit");
   assert(initModel != nullptr);
   double errorDiff = numeric_limits<double>::max();
   double prevError;
 
-  // Clear all previous fitting states
-  #ifdef DEBUG
-  cout << "Initialising fitting states." << endl;
-  #endif
+  // Clear all previous fitting states, the recycled candidates
+  // are dropped too as [initModel] may come with a different AAM
+  AAM_LOG(Debug) << "Initialising fitting states.";
   this->models.clear();
   this->buffer.clear();
+  this->dropped.clear();
+  this->pool.clear();
 
-  // Start with the given initial model
-  prevError = initModel->measureError(sample, skipPixels);
+  // Start with the given initial model, placed as per the criteria
   auto cloneInitModel = initModel->clone();
+  cloneInitModel->setOrigin(crit.initPos);
+  cloneInitModel->setScale(crit.initScale);
+  if (crit.coarseSearch) coarseSearch(cloneInitModel);
+  prevError = cloneInitModel->measureError(sample, skipPixels);
   models.push(cloneInitModel, prevError);
-  models.ptr->setOrigin(crit.initPos);
-  models.ptr->setScale(crit.initScale);
+  this->scheduler.reset();
+  updateROI();
 
-  #ifdef DEBUG
-  cout << GREEN << "[Model fitting started]" << RESET << endl;
-  cout << crit << endl;
-  cout << "[Init model]" << endl;
-  cout << *models.ptr << endl;
-  #endif
+  AAM_LOG(Info) << GREEN << "[Model fitting started]" << RESET;
+  AAM_LOG(Debug) << crit;
+  AAM_LOG(Debug) << "[Init model]" << endl << *models.ptr;
 
   // Adjust model parameters until converges
   int iter = 0;
-  double scale = 1;
   deque<SearchWith> ACTIONS = {
     TRANSLATION, SCALING, 
     TRANSLATION, SCALING, 
     RESHAPING, REAPPEARANCING
   };
+  if (crit.combinedSearch && aamPCA->hasCombinedPCA())
+  {
+    // Shape and appearance are searched jointly in the combined space
+    ACTIONS = { TRANSLATION, SCALING, TRANSLATION, SCALING, COMBINED };
+  }
+  if (crit.coarseSearch)
+  {
+    // Position and scale are already close, a single refinement is enough
+    ACTIONS.erase(ACTIONS.begin(), ACTIONS.begin() + 2);
+  }
   
   while (iter < crit.numMaxIter)
   {
-    #ifdef DEBUG
-    cout << CYAN << "Fitting model #" << iter << RESET << endl;
-    cout << YELLOW << "... Best error so far : " << models.v << RESET << endl;
-    #endif
+    AAM_LOG(Debug) << CYAN << "Fitting model #" << iter << RESET;
+    AAM_LOG(Debug) << YELLOW << "... Best error so far : " << models.v << RESET;
 
-    this->buffer.clear();
+    this->buffer.clear(&dropped);
+    this->pool.release(dropped);
 
-    #ifdef DEBUG
     models.printValueList("... Errors : ");
-    string actionStr = "";
-    switch (ACTIONS[0])
+    AAM_LOG(Debug) << "... Generating new models with " << ACTIONS[0];
+
+    SearchWith action = ACTIONS[0];
+    this->numEvaluated = 0;
+    this->numAccepted = 0;
+    this->numRejectedEarly = 0;
     {
-      case TRANSLATION: actionStr = "translation"; break;
-      case SCALING:     actionStr = "scaling"; break;
-      case RESHAPING:   actionStr = "reshaping"; break;
-      case REAPPEARANCING: actionStr = "reappearancing"; break;
+      TRACE_SCOPE("ModelFitter::expand");
+      iterateModelExpansion(&this->models, action, scheduler.step(action));
     }
-    cout << "... Generating new models with " << actionStr << endl;
-    #endif
-
-    iterateModelExpansion(&this->models, ACTIONS[0], scale);
+    TRACE_COUNT("fitter.iterations", 1);
+    scheduler.record(action, numEvaluated, numAccepted);
 
-    #ifdef DEBUG
-    cout << "... New models generated : " << min(buffer.size(), crit.numModelsToGeneratePerIter) << endl;
-    cout << "... Best error this iter : " << buffer.v << endl;
-    #endif
+    AAM_LOG(Debug) << "... New models generated : " << min(buffer.size(), crit.numModelsToGeneratePerIter);
+    AAM_LOG(Debug) << "... Rejected early : " << numRejectedEarly << " of " << numEvaluated;
+    AAM_LOG(Debug) << "... Best error this iter : " << buffer.v;
 
     double bestPrevError = models.v;
-    double bestNewError = buffer.v;
+    double bestNewError = buffer.ptr == nullptr ? bestPrevError : buffer.v;
 
     // Take best K buffered models into [models]
     transferFromBuffer(crit.numModelsToGeneratePerIter);
-    models.take(crit.maxTreeSize);
-
-    #ifdef DEBUG
-    cout << "... Tree size : " << models.size() << endl;
-    #endif
+    models.take(crit.maxTreeSize, &dropped);
+    pool.release(dropped);
 
     if (bestPrevError - bestNewError < crit.minErrorImprovement)
     {
-      // Shrink scale
-      if (scale > 0.125)
+      // Shrink the step of the stalled action
+      if (scheduler.shrink(action))
       {
-        scale *= 0.67; // TAOTOREVIEW: Use different decay ratios as per action
-        #ifdef DEBUG
-        cout << "... Steady error, shrinking scale to " << scale << endl;
-        #endif
+        AAM_LOG(Debug) << "... Steady error, shrinking step to " << scheduler.step(action);
       }
       else
       {
         // Iterate to the next action
-        if (ACTIONS.size()>0)
-        {
-          #ifdef DEBUG
-          cout << "... Steady error, iterate to next action" << endl;
-          #endif
-          ACTIONS.pop_front();
-          scale = 1;
-        }
-        else break;
+        AAM_LOG(Debug) << "... Steady error, iterate to next action";
+        scheduler.reset(action);
+        ACTIONS.pop_front();
+        if (ACTIONS.empty()) break;
       }
     }
+    else
+    {
+      // Still improving, tune the step by acceptance rate
+      scheduler.adapt(action);
+      AAM_LOG(Debug) << "... Acceptance rate " << scheduler.acceptanceRate(action) 
+        << ", step = " << scheduler.step(action);
+    }
+
+    // The region depends on the steps of the next expansion
+    updateROI();
+    AAM_LOG(Debug) << "... Tree size : " << models.size() << ", search region : " << roi;
 
     iter++;
   };
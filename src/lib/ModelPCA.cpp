@@ -2,10 +2,43 @@
 
 Mat ModelPCA::toParam(const BaseModel* m) const
 {
+  TRACE_SCOPE("ModelPCA::toParam");
   Mat vec = m->toRowVector();
   return this->pca.project(vec);
 }
 
+/**
+ * Generate a positive and a negative perturbation of each step
+ * for every component, one component at a time.
+ */
+void ModelPCA::generatePerturbations(const vector<double>& steps, bool scaleByEigenvalue, vector<Mat>& out) const
+{
+  ModelPCA::generatePerturbations(this->pca, steps, scaleByEigenvalue, out);
+}
+
+void ModelPCA::generatePerturbations(const PCA& pca, const vector<double>& steps, bool scaleByEigenvalue, vector<Mat>& out)
+{
+  int K = pca.eigenvalues.rows;
+  out.resize(2 * K * steps.size());
+  int n = 0;
+  for (auto step : steps)
+  {
+    for (int i=0; i<K; i++)
+    {
+      double sd = std::sqrt(max(0.0, pca.eigenvalues.at<double>(i)));
+      double d = scaleByEigenvalue ? step * sd : step;
+      out[n].create(1, K, CV_64FC1);
+      out[n].setTo(Scalar(0));
+      out[n].at<double>(0, i) = d;
+      ++n;
+      out[n].create(1, K, CV_64FC1);
+      out[n].setTo(Scalar(0));
+      out[n].at<double>(0, i) = -d;
+      ++n;
+    }
+  }
+}
+
 BaseModel* ShapeModelPCA::mean() const
 {
   return new MeshShape(this->pca.mean);
@@ -18,6 +51,7 @@ BaseModel* ShapeModelPCA::toModel(const Mat& param) const
 
 MeshShape* ShapeModelPCA::toShape(const Mat& param) const
 {
+  TRACE_SCOPE("ShapeModelPCA::toShape");
   Mat shapeParam = this->pca.backProject(param).reshape(1, param.cols/2);
   return new MeshShape(shapeParam);
 }
@@ -30,52 +64,25 @@ ShapeModelPCA ShapeModelPCA::cloneWithNewScale(double newScale, const Point2d& n
   return neue;
 }
 
-int ShapeModelPCA::getSizeOfPermutationOfParams() const
-{
-  int K = dimension();
-  int M = 16 * K;
-  return M;
-}
-
-void ShapeModelPCA::permutationOfParams(Mat* out) const
+BaseModel* AppearanceModelPCA::mean() const
 {
-  double steps[] = {0.01, -0.01, 0.1, -0.1, 1, -1, 10, -10};
-  int K = dimension();
-  int M = 16 * K;
-  int n = 0;
-  for (auto step : steps)
+  if (this->hasFrame())
   {
-    for (int i=0; i<K*2; i++)
-    {
-      if (i%2 == 0)
-      {
-        out[n] = Mat::zeros(1, K, CV_64FC1);
-        out[n].at<double>(0, i/2) = step;
-      }
-      else
-      {
-        out[n] = Mat::zeros(1, K, CV_64FC1);
-        out[n].at<double>(0, (i-1)/2) = -step;
-      }
-      ++n;
-    }
+    // Laid out on the frame, then warped onto the mean shape
+    return new Appearance(meanShape, this->frame.unwarp(this->frame.toGraphic(this->pca.mean), meanShape));
   }
-  assert(M == n);
-}
 
-BaseModel* AppearanceModelPCA::mean() const
-{
   auto bound = meanShape.getBound();
   auto N = bound.width * bound.height;
-  auto K = pca.mean.cols/3;
+  auto K = pca.mean.cols/channels;
 
   // Reshape the row vector into a spatial graphic for the appearance
-  Mat graphic = Mat(bound.height + bound.y, bound.width + bound.x, CV_8UC3, Scalar(0,0,0)); 
+  Mat graphic = Mat(bound.height + bound.y, bound.width + bound.x, CV_8UC(channels), Scalar::all(0)); 
   
-  // Split mean vector into 3 channels, scale them to the expected size
+  // Split mean vector into its channels, scale them to the expected size
   vector<Mat> meanChannels;
   Mat meanGraphic;
-  for (int i=0; i<3; i++)
+  for (int i=0; i<channels; i++)
   {
     Mat m = this->pca.mean(Rect(i*K, 0, K, 1)).clone();
     Mat c = Mat(1, N, CV_64FC1);
@@ -97,8 +104,19 @@ BaseModel* AppearanceModelPCA::toModel(const Mat& param) const
 
 Mat AppearanceModelPCA::toParam(const BaseModel* m) const
 {
+  TRACE_SCOPE("AppearanceModelPCA::toParam");
   const Appearance* app = dynamic_cast<const Appearance*>(m);
+  if (this->hasFrame())
+  {
+    MatArena& arena = MatArena::local();
+    MatArena::Scope scope(arena);
+    Mat vec = arena.acquire(1, this->frame.dimension(), CV_64FC1);
+    this->frame.toVector(*app, vec);
+    this->photometric.normalise(vec);
+    return this->pca.project(vec);
+  }
   Mat vec = app->toRowVectorReduced(this->pca.mean.cols);
+  this->photometric.normalise(vec);
   return this->pca.project(vec);
 }
 
@@ -107,39 +125,6 @@ void AppearanceModelPCA::overrideMeanShape(const MeshShape& newMeanShape)
   this->meanShape = newMeanShape;
 }
 
-int AppearanceModelPCA::getSizeOfPermutationOfParams() const
-{
-  int K = dimension();
-  int M = 8 * K * 2;
-  return M;
-}
-
-void AppearanceModelPCA::permutationOfParams(Mat* out) const
-{
-  double steps[] = {0.1, -0.1, 0.01, -0.01, 1, -1, 10, -10};
-  int K = dimension();
-  int M = 8 * K * 2;
-  int n = 0;
-  for (auto step : steps)
-  {
-    for (int i=0; i<K*2; i++)
-    {
-      if (i%2 == 0)
-      {
-        out[n] = Mat::zeros(1, K, CV_64FC1);
-        out[n].at<double>(0, i/2) = step;
-      }
-      else
-      {
-        out[n] = Mat::zeros(1, K, CV_64FC1);
-        out[n].at<double>(0, (i-1)/2) = -step;
-      }
-      ++n;
-    }
-  }
-  assert(M == n);
-}
-
 Rect AppearanceModelPCA::getBound() const
 {
   Rect b = meanShape.getBound();
@@ -160,38 +145,54 @@ AppearanceModelPCA AppearanceModelPCA::cloneWithNewScale(double newScale, const
 
 Appearance* AppearanceModelPCA::toAppearance(const Mat& param) const
 {
+  TRACE_SCOPE("AppearanceModelPCA::toAppearance");
   // Generate a mean appearance model
   // then apply translation, scaling, and parameters later
 
+  // All intermediate graphics live in the scratch arena,
+  // the final [Appearance] takes its own copy of the pixels.
+  MatArena& arena = MatArena::local();
+  MatArena::Scope scope(arena);
+
+  // Backprojection from PCA parameters to image
+  Mat backPrj = arena.acquire(1, pca.mean.cols, CV_64FC1);
+  this->pca.backProject(param, backPrj);
+
+  if (this->hasFrame())
+  {
+    // The frame lays the pixels out over its own copy of the mean shape,
+    // they are warped straight onto the rescaled and re-positioned mean shape
+    Mat frameGraphic = arena.acquire(this->frame.getSize(), CV_8UC(channels));
+    this->frame.toGraphic(backPrj, frameGraphic);
+    auto modelShape = MeshShape(meanShape.recentreAndScale(translation, scale));
+    return new Appearance(modelShape, this->frame.unwarp(frameGraphic, modelShape));
+  }
+
   auto bound = meanShape.getBound();
   auto N = bound.width * bound.height;
-  auto K = pca.mean.cols/3;
+  auto K = pca.mean.cols/channels;
   auto margin = bound.tl();
 
-  Mat modelInitGraphic;
-
-  // Backprojection from PCA parameters to image
-  Mat backPrj = this->pca.backProject(param);
-  
-  // Split backprojected vector into 3 channels, scale them to the expected size
-  vector<Mat> bpjChannels;
+  Mat modelInitGraphic = arena.acquire(bound.height, bound.width, CV_8UC(channels));
 
-  for (int i=0; i<3; i++)
+  // Split backprojected vector into its channels, scale them to the expected size
+  Mat bpjChannels[3];
+  Mat c = arena.acquire(1, N, CV_64FC1);
+  for (int i=0; i<channels; i++)
   {
-    Mat m = backPrj(Rect(i*K, 0, K, 1)).clone();
-    Mat c = Mat(1, N, CV_64FC1);
+    Mat m = backPrj(Rect(i*K, 0, K, 1));
     resize(m, c, Size(N, 1));
-    Mat meanCh = Mat(Size(N, 1), CV_8UC1);
+    Mat meanCh = arena.acquire(1, N, CV_8UC1);
     c.convertTo(meanCh, CV_8UC1);
-    bpjChannels.push_back(meanCh.reshape(1, bound.height));
+    bpjChannels[i] = meanCh.reshape(1, bound.height);
   }
-  merge(bpjChannels, modelInitGraphic);
+  merge(bpjChannels, channels, modelInitGraphic);
 
   // Add shape margin
-  Mat modelInitGraphicWithMargin = Mat::zeros(
+  Mat modelInitGraphicWithMargin = arena.zeros(
     modelInitGraphic.rows + margin.y,
     modelInitGraphic.cols + margin.x,
-    CV_8UC3);
+    CV_8UC(channels));
   modelInitGraphic.copyTo(modelInitGraphicWithMargin(Rect(margin.x, margin.y, modelInitGraphic.cols, modelInitGraphic.rows)));
 
   // Rescale and re-position the graphic
@@ -201,7 +202,7 @@ Appearance* AppearanceModelPCA::toAppearance(const Mat& param) const
   int h0 = (int)ceil(modelInitGraphicWithMargin.rows*scale);
   int w = w0 + tx;
   int h = h0 + ty;
-  Mat modelGraphic = Mat::zeros(h, w, CV_8UC3);
+  Mat modelGraphic = arena.zeros(h, w, CV_8UC(channels));
   resize( 
     modelInitGraphicWithMargin,
     modelGraphic(Rect(tx, ty, w0, h0)),
@@ -216,4 +217,55 @@ Appearance* AppearanceModelPCA::toAppearance(const Mat& param) const
   return appearance;
 }
 
+CombinedModelPCA::CombinedModelPCA(
+  const Mat& shapeParams, 
+  const Mat& appearanceParams, 
+  double shapeWeight, 
+  double retainedVariance)
+: shapeWeight(shapeWeight), 
+  shapeDimension(shapeParams.cols), 
+  appearanceDimension(appearanceParams.cols)
+{
+  assert(shapeParams.rows == appearanceParams.rows);
+
+  // Each row concatenates [Ws * bs, ba] of a training sample
+  Mat data(shapeParams.rows, shapeDimension + appearanceDimension, CV_64FC1);
+  Mat weightedShape = shapeParams * shapeWeight;
+  weightedShape.copyTo(data(Rect(0, 0, shapeDimension, data.rows)));
+  appearanceParams.copyTo(data(Rect(shapeDimension, 0, appearanceDimension, data.rows)));
+
+  this->pca = PCA(data, Mat(), cv::PCA::DATA_AS_ROW, retainedVariance);
+
+  AAM_LOG(Info) << "CombinedModelPCA : " << data.cols << " params ~> " 
+    << dimension() << " components (Ws = " << shapeWeight << ")";
+}
+
+/**
+ * Displacement of the shape and appearance parameters along [delta]
+ * of the combined components, without going through the combined subspace.
+ * Adding it to any parameters keeps whatever the subspace does not retain.
+ */
+void CombinedModelPCA::toShapeAndAppearanceDeltas(const Mat& delta, Mat& shapeDelta, Mat& appearanceDelta) const
+{
+  Mat b = delta * this->pca.eigenvectors;
+  shapeDelta = b(Rect(0, 0, shapeDimension, 1)) * (1.0 / shapeWeight);
+  b(Rect(shapeDimension, 0, appearanceDimension, 1)).copyTo(appearanceDelta);
+}
+
+void CombinedModelPCA::generatePerturbations(const vector<double>& steps, bool scaleByEigenvalue, vector<Mat>& out) const
+{
+  ModelPCA::generatePerturbations(this->pca, steps, scaleByEigenvalue, out);
+}
 
+/**
+ * Build the combined model from the parameters of the training samples,
+ * one sample per row. The shape weight is the classic ratio of 
+ * total appearance variance over total shape variance.
+ */
+void AAMPCA::trainCombined(const Mat& shapeParams, const Mat& appearanceParams, double retainedVariance)
+{
+  double varShape = pcaShape.totalVariance();
+  double varAppearance = pcaAppearance.totalVariance();
+  double weight = (varShape > 0 && varAppearance > 0) ? std::sqrt(varAppearance / varShape) : 1.0;
+  this->pcaCombined = CombinedModelPCA(shapeParams, appearanceParams, weight, retainedVariance);
+}
@@ -0,0 +1,18 @@
+#include "PerturbationTable.h"
+
+PerturbationTable::PerturbationTable(const AAMPCA& aamPCA, const PerturbationSteps& steps)
+: scales(steps.scales), translations(steps.translations)
+{
+  aamPCA.getShapePCA().generatePerturbations(
+    steps.shapeSteps, steps.scaleByEigenvalue, this->shapeParams);
+  aamPCA.getAppearancePCA().generatePerturbations(
+    steps.appearanceSteps, steps.scaleByEigenvalue, this->appearanceParams);
+  if (aamPCA.hasCombinedPCA())
+    aamPCA.getCombinedPCA().generatePerturbations(
+      steps.combinedSteps, steps.scaleByEigenvalue, this->combinedParams);
+
+  AAM_LOG(Debug) << "PerturbationTable : "
+    << this->shapeParams.size() << " shape / "
+    << this->appearanceParams.size() << " appearance / "
+    << this->combinedParams.size() << " combined perturbations";
+}
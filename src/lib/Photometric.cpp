@@ -0,0 +1,89 @@
+#include "Photometric.h"
+
+PhotometricNormaliser::PhotometricNormaliser(PhotometricMode m, int channels)
+: mode(m), channels(channels)
+{
+  assert(channels == 1 || channels == 3);
+  for (int c=0; c<3; c++)
+  {
+    this->targetMean[c] = 0;
+    this->targetStd[c]  = 1;
+  }
+}
+
+namespace
+{
+  // Mean and standard deviation of [n] consecutive elements
+  inline void meanStd(const double* v, int n, double& mean, double& sd)
+  {
+    double s = 0, ss = 0;
+    for (int k=0; k<n; k++)
+    {
+      s  += v[k];
+      ss += v[k]*v[k];
+    }
+    mean = s/n;
+    sd   = std::sqrt(max(0.0, ss/n - mean*mean));
+  }
+}
+
+/**
+ * Targets are the average statistics of the rows of [data]
+ */
+void PhotometricNormaliser::train(const Mat& data)
+{
+  if (!this->isEnabled() || data.rows == 0) return;
+  assert(data.type() == CV_64FC1 && data.cols % this->channels == 0);
+
+  const bool perChannel = this->mode == PHOTOMETRIC_PER_CHANNEL;
+  const int numGroups = perChannel ? this->channels : 1;
+  const int len = data.cols / numGroups;
+  for (int c=0; c<3; c++)
+  {
+    this->targetMean[c] = 0;
+    this->targetStd[c]  = 0;
+  }
+  for (int j=0; j<data.rows; j++)
+  {
+    const double* row = data.ptr<double>(j);
+    for (int g=0; g<numGroups; g++)
+    {
+      double mean, sd;
+      meanStd(row + g*len, len, mean, sd);
+      this->targetMean[g] += mean / data.rows;
+      this->targetStd[g]  += sd / data.rows;
+    }
+  }
+  if (numGroups == 1)
+  {
+    this->targetMean[1] = this->targetMean[2] = this->targetMean[0];
+    this->targetStd[1]  = this->targetStd[2]  = this->targetStd[0];
+  }
+
+  AAM_LOG(Debug) << "PhotometricNormaliser : target mean = " << this->targetMean[0]
+    << ", std = " << this->targetStd[0] << (perChannel ? " (channel #0)" : "");
+}
+
+/**
+ * Bring a 1 x (channels * K) vector to the target statistics, in place
+ */
+void PhotometricNormaliser::normalise(Mat vec) const
+{
+  if (!this->isEnabled()) return;
+  assert(vec.rows == 1 && vec.type() == CV_64FC1 && vec.cols % this->channels == 0);
+
+  const int numGroups = this->mode == PHOTOMETRIC_PER_CHANNEL ? this->channels : 1;
+  const int len = vec.cols / numGroups;
+  double* v = vec.ptr<double>(0);
+  for (int g=0; g<numGroups; g++)
+  {
+    double* u = v + g*len;
+    double mean, sd;
+    meanStd(u, len, mean, sd);
+    const double k = sd > 1e-9 ? this->targetStd[g] / sd : 0;
+    for (int i=0; i<len; i++)
+    {
+      u[i] = (u[i] - mean) * k + this->targetMean[g];
+    }
+  }
+}
@@ -0,0 +1,151 @@
+#include "ReferenceFrame.h"
+
+namespace
+{
+  // Planar vector <-> pixels of the frame
+  template<int CN> struct GatherPixels
+  {
+    static void run(const Mat& graphic, const vector<Point>& pixels, double* v)
+    {
+      typedef typename PixelOf<CN>::type Pixel;
+      const int P = pixels.size();
+      for (int k=0; k<P; k++)
+      {
+        const Pixel& px = graphic.at<Pixel>(pixels[k]);
+        for (int c=0; c<CN; c++) v[c*P + k] = channelOf<CN>(px, c);
+      }
+    }
+  };
+
+  template<int CN> struct ScatterPixels
+  {
+    static void run(const double* v, const vector<Point>& pixels, Mat& graphic)
+    {
+      typedef typename PixelOf<CN>::type Pixel;
+      const int P = pixels.size();
+      for (int k=0; k<P; k++)
+      {
+        Pixel& px = graphic.at<Pixel>(pixels[k]);
+        for (int c=0; c<CN; c++) setChannel<CN>(px, c, saturate_cast<unsigned char>(v[c*P + k]));
+      }
+    }
+  };
+}
+
+/**
+ * Rescale [meanShape] so its bound spans [width] pixels (minus the border)
+ * and collect the pixels covered by the mesh
+ */
+ReferenceFrame::ReferenceFrame(const Shape& meanShape, int width, int channels)
+: meanShape(meanShape.getMat()), channels(channels)
+{
+  assert(width > 2*BORDER + 1);
+  Mat m = meanShape.getMat();
+  double minX, maxX, minY, maxY;
+  minMaxLoc(m.col(0), &minX, &maxX);
+  minMaxLoc(m.col(1), &minY, &maxY);
+  double k = (width - 1 - 2*BORDER) / max(maxX - minX, 1e-12);
+
+  Mat framed(m.rows, 2, CV_64FC1);
+  for (int j=0; j<m.rows; j++)
+  {
+    framed.at<double>(j,0) = (m.at<double>(j,0) - minX) * k + BORDER;
+    framed.at<double>(j,1) = (m.at<double>(j,1) - minY) * k + BORDER;
+  }
+  this->shape = MeshShape(framed);
+  this->size  = Size(width, (int)ceil((maxY - minY) * k) + 2*BORDER + 1);
+
+  // The Delaunay mesh covers the convex hull of the vertices
+  Mat hull = this->shape.convexFill();
+  Rect common(0, 0, min(hull.cols, size.width), min(hull.rows, size.height));
+  this->mask = Mat::zeros(this->size, CV_8UC1);
+  hull(common).copyTo(this->mask(common));
+
+  for (int j=0; j<this->size.height; j++)
+  {
+    const unsigned char* row = this->mask.ptr<unsigned char>(j);
+    for (int i=0; i<this->size.width; i++)
+      if (row[i] > 0) this->pixels.push_back(Point(i, j));
+  }
+
+  AAM_LOG(Debug) << "ReferenceFrame : " << this->size << " with "
+    << this->numPixels() << " pixels inside the mesh";
+}
+
+/**
+ * Warp each texture of [app] onto its triangle of the frame.
+ * The triangles are matched by vertex indices, so the frame
+ * does not depend on the triangulation of the mean shape.
+ */
+Mat ReferenceFrame::warp(const Appearance& app) const
+{
+  TRACE_SCOPE("ReferenceFrame::warp");
+  assert(app.getShape().mat.rows == this->shape.mat.rows);
+
+  // Triangle bounding rects may overrun the frame by a pixel
+  const int span = BORDER + 1;
+  Mat canvas = Mat::zeros(this->size.height + span, this->size.width + span, app.getGraphic().type());
+  Mat vertices = this->shape.mat;
+  for (auto& texture : app.getTextures())
+  {
+    texture.realignTo(texture.bound, &vertices, &canvas);
+  }
+  return canvas(Rect(Point(0,0), this->size));
+}
+
+Mat ReferenceFrame::toVector(const Appearance& app) const
+{
+  Mat vec(1, this->dimension(), CV_64FC1);
+  this->toVector(app, vec);
+  return vec;
+}
+
+void ReferenceFrame::toVector(const Appearance& app, Mat out) const
+{
+  assert(out.rows == 1 && out.cols == this->dimension() && out.type() == CV_64FC1);
+  Mat warped = this->warp(app);
+  assert(warped.channels() == this->channels);
+  dispatchChannels<GatherPixels>(this->channels, warped, this->pixels, out.ptr<double>(0));
+}
+
+Mat ReferenceFrame::toGraphic(const Mat& vec) const
+{
+  Mat graphic;
+  this->toGraphic(vec, graphic);
+  return graphic;
+}
+
+/**
+ * Spread an appearance vector back onto the frame,
+ * pixels outside of the mesh are black
+ */
+void ReferenceFrame::toGraphic(const Mat& vec, Mat& graphic) const
+{
+  assert(vec.cols == this->dimension() && vec.type() == CV_64FC1);
+  graphic.create(this->size, CV_8UC(this->channels));
+  graphic.setTo(Scalar::all(0));
+  dispatchChannels<ScatterPixels>(this->channels, vec.ptr<double>(0), this->pixels, graphic);
+}
+
+/**
+ * Warp a graphic laid out on the frame onto [target],
+ * the inverse of [warp]. Triangles are matched by vertex indices.
+ */
+Mat ReferenceFrame::unwarp(const Mat& graphic, const MeshShape& target) const
+{
+  TRACE_SCOPE("ReferenceFrame::unwarp");
+  assert(target.mat.rows == this->shape.mat.rows);
+  assert(graphic.size() == this->size);
+
+  const int span = BORDER + 1;
+  Size spanned = target.getSpannedSize();
+  Mat canvas = Mat::zeros(spanned.height + span, spanned.width + span, graphic.type());
+  Mat source = graphic;
+  Mat vertices = this->shape.mat;
+  Mat targetVertices = target.mat;
+  for (auto& triangle : this->shape.getTriangles())
+  {
+    Texture(triangle, &vertices, &source).realignTo(triangle, &targetVertices, &canvas);
+  }
+  return canvas;
+}
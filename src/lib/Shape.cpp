@@ -68,6 +68,8 @@ const double Shape::procrustesDistance(const BaseModel* that) const
 
 Mat Shape::render(IO::GenericIO* io, Mat background, double scaleFactor, Point2d recentre) const
 {
+  if (IO::isHeadless(io)) return background;
+
   // Render shape vertices
   int N = this->mat.rows;
   Mat canvas = background.clone();
@@ -224,10 +226,10 @@ void Shape::addRandomNoise(const Point2d& maxDisplacement)
   int N = this->mat.rows;
   for (int j=0; j<N; j++)
   {
-    double nx1 = maxDisplacement.x/2 * static_cast<double>(rand()) / static_cast<double>(RAND_MAX);
-    double ny1 = maxDisplacement.y/2 * static_cast<double>(rand()) / static_cast<double>(RAND_MAX);
-    double nx2 = maxDisplacement.x/2 * static_cast<double>(rand()) / static_cast<double>(RAND_MAX);
-    double ny2 = maxDisplacement.y/2 * static_cast<double>(rand()) / static_cast<double>(RAND_MAX);
+    double nx1 = Random::uniform(0, maxDisplacement.x/2);
+    double ny1 = Random::uniform(0, maxDisplacement.y/2);
+    double nx2 = Random::uniform(0, maxDisplacement.x/2);
+    double ny2 = Random::uniform(0, maxDisplacement.y/2);
     moveVertex(j, Point2d(nx1 - nx2, ny1 - ny2));
   }
 }
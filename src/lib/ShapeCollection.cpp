@@ -3,93 +3,96 @@
 ShapeCollection::ShapeCollection(const vector<Shape*>& shapes)
 : ModelCollection()
 {
-  vector<BaseModel*> vs;
+  this->items.reserve(shapes.size());
   for (auto shape : shapes)
   {
-    vs.push_back(shape);
+    this->items.emplace_back(shape);
   }
-  this->items = vs;
 }
 
-unique_ptr<ModelCollection> ShapeCollection::clone() const
+ShapeCollection::ShapeCollection(const ShapeCollection& original)
+: ModelCollection()
 {
-  #ifdef DEBUG
-  cout << "BaseModelShapeCollection::clone " << getUID() << endl;
-  #endif
   // Deep copy
-  vector<BaseModel*> clonedVector;
-  for (auto model : this->items)
+  this->items.reserve(original.items.size());
+  for (auto& model : original.items)
   {
-    auto shape = dynamic_cast<Shape*>(model);
-    clonedVector.push_back(new Shape(*shape));
+    auto shape = dynamic_cast<Shape*>(model.get());
+    this->items.emplace_back(new Shape(*shape));
   }
-  unique_ptr<ModelCollection> newSet(new ShapeCollection(clonedVector));
+}
+
+unique_ptr<ModelCollection> ShapeCollection::clone() const
+{
+  AAM_LOG(Verbose) << "BaseModelShapeCollection::clone " << getUID();
+  unique_ptr<ModelCollection> newSet(new ShapeCollection(*this));
   return newSet;
 }
 
 void ShapeCollection::normaliseScalingTranslation()
 {
-  #ifdef DEBUG
-  cout << "BaseModelShapeCollection::normaliseScalingTranslation @" << getUID() << endl;
-  #endif
+  AAM_LOG(Debug) << "BaseModelShapeCollection::normaliseScalingTranslation @" << getUID();
   // Rescale each shape so the centroid size = 1
   // and translate to the centroid
-  vector<BaseModel*> scaled;
-  for (auto model : this->items)
-  {
-    auto shape = dynamic_cast<Shape*>(model);
-    auto centroid = shape->centroid();
-    auto cdist    = shape->sumSquareDistanceToPoint(centroid);
-    scaled.push_back(new Shape((*shape << centroid) * (1.0/cdist)));
-  }
-  // Replace with new items
-  clear();
-  swap(this->items, scaled);
+  ShapeSet set(this->getItems());
+  set.normaliseScalingTranslation();
+  set.scatterTo(this->items);
 }
 
 void ShapeCollection::translateBy(const Point2d &p)
 {
-  vector<BaseModel*> tr;
-  for (auto model : this->items)
-  {
-    Shape* shape = dynamic_cast<Shape*>(model);
-    tr.push_back(new Shape(*shape >> p));
-  }
-  clear();
-  swap(this->items, tr);
+  ShapeSet set(this->getItems());
+  set.translateBy(p);
+  set.scatterTo(this->items);
 }
 
 void ShapeCollection::normaliseRotation()
 {
-  #ifdef DEBUG
-  cout << "ShapeCollection::normaliseRotation" << endl;
-  #endif
+  AAM_LOG(Debug) << "ShapeCollection::normaliseRotation";
 
   // Use the first shape as base rotation = 0
-  Mat x0 = this->items[0]->getMat();
-  vector<BaseModel*> norml{ new Shape(x0) };
-  
-  for (auto shapeIter=this->items.begin()+1; shapeIter!=this->items.end(); shapeIter++)
+  ShapeSet set(this->getItems());
+  set.normaliseRotation(0);
+  set.scatterTo(this->items);
+}
+
+double ShapeCollection::sumProcrustesDistance(const BaseModel* targetModel) const
+{
+  auto target = dynamic_cast<const Shape*>(targetModel);
+  return ShapeSet(this->getItems()).sumProcrustesDistance(*target);
+}
+
+/**
+ * Same iterations as [ModelCollection::procrustesMean], run on a single
+ * [ShapeSet] gathered once, the aligned shapes are scattered back at the end
+ */
+unique_ptr<BaseModel> ShapeCollection::procrustesMean(double tol, int maxIter)
+{
+  AAM_LOG(Debug) << "ShapeCollection::procrustesMean @" << getUID();
+  double lastError = 0;
+  double tl        = numeric_limits<double>::max();
+  int iter         = 0;
+
+  auto tolerance = [&](double e, double e0)
   {
-    // Compute SVD on xj•x0
-    Mat xj = (*shapeIter)->getMat();
-    Mat xx = xj.t() * x0;
-    auto svd = SVD(xx, SVD::FULL_UV);
-    auto u = svd.u;
-    auto v = svd.vt.t();
-    Mat R = v * u.t();
-
-    #ifdef DEBUG
-    double angle = acos(R.at<double>(0,0)) / M_PI;
-    cout << "... Compensating rotation of next shape (angle = " << angle << "π)" << endl;
-    #endif
-
-    // rotate shape by theta and store in norm<>
-    norml.push_back(new Shape((R * xj.t()).t()));
+    return abs(e-e0)/min(e0,e);
+  };
+
+  ShapeSet set(this->getItems());
+  Shape mean;
+  while (tl > tol && iter < maxIter)
+  {
+    set.normaliseRotation(0);
+    set.toShape(0, mean);
+    double err = set.sumProcrustesDistance(mean);
+
+    iter++;
+    tl = tolerance(err, lastError);
+    lastError = err;
   }
 
-  clear();
-  swap(this->items, norml);
+  set.scatterTo(this->items);
+  return this->items[0]->clone();
 }
 
 /**
@@ -98,25 +101,18 @@ void ShapeCollection::normaliseRotation()
  */
 Mat ShapeCollection::toMat() const
 {
-  int N = this->items.size();
-  int M = this->items[0]->toRowVector().cols;
-  Mat m = Mat(N, M, CV_64FC1);
-
-  int j = 0;
-  for (auto model : this->items)
-  {
-    model->toRowVector().row(0).copyTo(m.row(j));
-    j++;
-  }
-  return m;
+  return ShapeSet(this->getItems()).toMat();
 }
 
 void ShapeCollection::renderShapeVariation(IO::GenericIO* io, Size sz, double scaleFactor, Point2d recentred) const
 {
+  // Nothing to draw nor to wait for
+  if (IO::isHeadless(io)) return;
+
   Mat canvas = Mat::zeros(sz, CV_8UC3);
-  for (auto model : this->items)
+  for (auto& model : this->items)
   {
-    auto shape = dynamic_cast<Shape*>(model);
+    auto shape = dynamic_cast<Shape*>(model.get());
     canvas = shape->render(io, canvas, scaleFactor, recentred);
     waitKey(4000);
   }
@@ -0,0 +1,218 @@
+#include <typeinfo>
+#include "ShapeSet.h"
+
+namespace
+{
+  // Number of landmarks, constant when specialised
+  template<int M> inline int landmarks(int m) { return M > 0 ? M : m; }
+
+  template<int M> struct CentreAndScale
+  {
+    static void run(int m, double* px, double* py, double cx, double cy)
+    {
+      const int N = landmarks<M>(m);
+      double cdist = 0;
+      for (int j=0; j<N; j++)
+      {
+        px[j] -= cx;
+        py[j] -= cy;
+        cdist += px[j]*px[j] + py[j]*py[j];
+      }
+      const double k = 1.0/cdist;
+      for (int j=0; j<N; j++)
+      {
+        px[j] *= k;
+        py[j] *= k;
+      }
+    }
+  };
+
+  template<int M> struct RotateOnto
+  {
+    static void run(int m, double* px, double* py, const double* bx, const double* by)
+    {
+      const int N = landmarks<M>(m);
+      double a = 0, b = 0, c = 0, d = 0;
+      for (int j=0; j<N; j++)
+      {
+        a += px[j]*bx[j];
+        b += px[j]*by[j];
+        c += py[j]*bx[j];
+        d += py[j]*by[j];
+      }
+
+      double xxData[] = { a, b, c, d };
+      Mat xx(2, 2, CV_64FC1, xxData);
+      auto svd = SVD(xx, SVD::FULL_UV);
+      Mat R = svd.vt.t() * svd.u.t();
+      const double r00 = R.at<double>(0,0), r01 = R.at<double>(0,1);
+      const double r10 = R.at<double>(1,0), r11 = R.at<double>(1,1);
+
+      for (int j=0; j<N; j++)
+      {
+        const double xj = px[j];
+        const double yj = py[j];
+        px[j] = r00*xj + r01*yj;
+        py[j] = r10*xj + r11*yj;
+      }
+    }
+  };
+
+  // [t] is the interleaved (x0,y0,x1,y1,...) target
+  template<int M> struct SquaredDistance
+  {
+    static double run(int m, const double* px, const double* py, const double* t)
+    {
+      const int N = landmarks<M>(m);
+      double dist = 0;
+      for (int j=0; j<N; j++)
+        dist += Aux::square(px[j] - t[2*j]) + Aux::square(py[j] - t[2*j+1]);
+      return dist;
+    }
+  };
+}
+
+ShapeSet::ShapeSet(int numShapes, int numPoints)
+: xs(numShapes, numPoints, CV_64FC1), ys(numShapes, numPoints, CV_64FC1)
+{
+}
+
+ShapeSet::ShapeSet(const vector<BaseModel*>& shapes)
+{
+  assert(!shapes.empty());
+  int N = shapes.size();
+  int M = shapes[0]->getMat().rows;
+  this->xs.create(N, M, CV_64FC1);
+  this->ys.create(N, M, CV_64FC1);
+
+  // Gather the interleaved (x,y) rows of each shape into the two planes
+  for (int i=0; i<N; i++)
+  {
+    Mat m = shapes[i]->getMat();
+    assert(m.rows == M && m.cols == 2);
+    double* px = this->x(i);
+    double* py = this->y(i);
+    for (int j=0; j<M; j++)
+    {
+      const double* row = m.ptr<double>(j);
+      px[j] = row[0];
+      py[j] = row[1];
+    }
+  }
+}
+
+Mat ShapeSet::centroids() const
+{
+  Mat c(this->size(), 2, CV_64FC1);
+  reduce(this->xs, c.col(0), 1, REDUCE_AVG);
+  reduce(this->ys, c.col(1), 1, REDUCE_AVG);
+  return c;
+}
+
+void ShapeSet::translateBy(const Point2d& p)
+{
+  this->xs += p.x;
+  this->ys += p.y;
+}
+
+/**
+ * Translate each shape to its centroid and divide it by
+ * its sum of square distances to the centroid,
+ * identical to [ShapeCollection::normaliseScalingTranslation]
+ */
+void ShapeSet::normaliseScalingTranslation()
+{
+  int M = this->numPoints();
+  Mat c = this->centroids();
+  for (int i=0; i<this->size(); i++)
+  {
+    dispatchLandmarks<CentreAndScale>(M, this->x(i), this->y(i),
+      c.at<double>(i,0), c.at<double>(i,1));
+  }
+}
+
+/**
+ * Rotate every shape onto the shape at [baseIndex].
+ * The 2x2 cross product xjᵀ•x0 is accumulated directly
+ * from the coordinate planes, then R = V•Uᵀ from its SVD.
+ */
+void ShapeSet::normaliseRotation(int baseIndex)
+{
+  int M = this->numPoints();
+  const double* bx = this->x(baseIndex);
+  const double* by = this->y(baseIndex);
+  for (int i=0; i<this->size(); i++)
+  {
+    if (i == baseIndex) continue;
+    dispatchLandmarks<RotateOnto>(M, this->x(i), this->y(i), bx, by);
+  }
+}
+
+double ShapeSet::sumProcrustesDistance(const Shape& target) const
+{
+  int M = this->numPoints();
+  Mat t = target.getMat();
+  assert(t.rows == M);
+  if (!t.isContinuous()) t = t.clone();
+  const double* tp = t.ptr<double>(0);
+  double sumDist = 0.0;
+  for (int i=0; i<this->size(); i++)
+  {
+    sumDist += dispatchLandmarks<SquaredDistance>(M, this->x(i), this->y(i), tp);
+  }
+  return sumDist;
+}
+
+/**
+ * Interleaved layout (x0,y0,x1,y1,...) per row,
+ * identical to [Shape::toRowVector]
+ */
+Mat ShapeSet::toMat() const
+{
+  int M = this->numPoints();
+  Mat m(this->size(), 2*M, CV_64FC1);
+  for (int i=0; i<this->size(); i++)
+  {
+    const double* px = this->x(i);
+    const double* py = this->y(i);
+    double* row = m.ptr<double>(i);
+    for (int j=0; j<M; j++)
+    {
+      row[2*j]   = px[j];
+      row[2*j+1] = py[j];
+    }
+  }
+  return m;
+}
+
+void ShapeSet::toShape(int i, Shape& out) const
+{
+  int M = this->numPoints();
+  out.mat.create(M, 2, CV_64FC1);
+  const double* px = this->x(i);
+  const double* py = this->y(i);
+  for (int j=0; j<M; j++)
+  {
+    double* row = out.mat.ptr<double>(j);
+    row[0] = px[j];
+    row[1] = py[j];
+  }
+}
+
+/**
+ * Write the coordinates back onto [shapes] in place.
+ * Derived shapes (e.g. [MeshShape]) hold caches computed from
+ * their vertices, so they are replaced by a plain [Shape] instead.
+ */
+void ShapeSet::scatterTo(vector<unique_ptr<BaseModel>>& shapes) const
+{
+  assert((int)shapes.size() == this->size());
+  for (int i=0; i<this->size(); i++)
+  {
+    if (typeid(*shapes[i]) != typeid(Shape))
+    {
+      shapes[i].reset(new Shape());
+    }
+    this->toShape(i, *static_cast<Shape*>(shapes[i].get()));
+  }
+}
@@ -0,0 +1,57 @@
+#include "StepScheduler.h"
+
+StepScheduler::StepScheduler(const StepPolicy& policy) : policy(policy)
+{
+  reset();
+}
+
+void StepScheduler::reset()
+{
+  for (int i=0; i<NUM_SEARCH_ACTIONS; i++)
+  {
+    reset(static_cast<SearchWith>(i));
+    this->numEvaluated[i] = 0;
+    this->numAccepted[i] = 0;
+  }
+}
+
+void StepScheduler::reset(SearchWith action)
+{
+  this->steps[action] = this->policy.maxStep;
+  this->lastAcceptance[action] = 0;
+}
+
+/**
+ * Register the outcome of one expansion of [action]
+ */
+void StepScheduler::record(SearchWith action, int evaluated, int accepted)
+{
+  this->numEvaluated[action] += evaluated;
+  this->numAccepted[action] += accepted;
+  this->lastAcceptance[action] = evaluated > 0 ? (double)accepted / (double)evaluated : 0;
+}
+
+/**
+ * Grow the step while most candidates improve,
+ * shrink it when almost none of them do.
+ */
+void StepScheduler::adapt(SearchWith action)
+{
+  double rate = this->lastAcceptance[action];
+  if (rate > this->policy.highAcceptance)
+    this->steps[action] = min(this->policy.maxStep, this->steps[action] * this->policy.growth);
+  else if (rate < this->policy.lowAcceptance)
+    this->steps[action] = max(this->policy.minStep, this->steps[action] * this->policy.decay);
+}
+
+/**
+ * Shrink the step of a stalled action.
+ * Returns false if the action is exhausted (step can't shrink any further).
+ */
+bool StepScheduler::shrink(SearchWith action)
+{
+  if (this->steps[action] <= this->policy.minStep)
+    return false;
+  this->steps[action] *= this->policy.decay;
+  return true;
+}
@@ -1,5 +1,134 @@
+#include <cstring>
 #include "Texture.h"
 
+namespace
+{
+  // Copy the pixels of [src] under [mask] into [dest] at [offset]
+  template<int CN> struct CopyMasked
+  {
+    static void run(const Mat& src, const Mat& mask, Mat& dest, Point offset)
+    {
+      typedef typename PixelOf<CN>::type Pixel;
+      int x0 = max(0, -offset.x), y0 = max(0, -offset.y);
+      int x1 = min(min(src.cols, mask.cols), dest.cols - offset.x);
+      int y1 = min(min(src.rows, mask.rows), dest.rows - offset.y);
+      for (int y=y0; y<y1; y++)
+      {
+        const unsigned char* m = mask.ptr<unsigned char>(y);
+        const Pixel* ps = src.ptr<Pixel>(y);
+        Pixel* pd = dest.ptr<Pixel>(y + offset.y) + offset.x;
+        for (int x=x0; x<x1; x++)
+          if (m[x] > 0) pd[x] = ps[x];
+      }
+    }
+  };
+
+  bool sameVertices(const Mat& a, const Mat& b)
+  {
+    if (a.rows != b.rows || a.cols != b.cols || a.type() != b.type()) return false;
+    size_t rowBytes = a.cols * a.elemSize();
+    for (int j=0; j<a.rows; j++)
+      if (memcmp(a.ptr(j), b.ptr(j), rowBytes) != 0) return false;
+    return true;
+  }
+
+  bool sameTriangles(const vector<Triangle>& triangles, const vector<Texture>& textures)
+  {
+    if (triangles.size() != textures.size()) return false;
+    for (size_t i=0; i<triangles.size(); i++)
+    {
+      const Triangle& t = textures[i].bound;
+      if (triangles[i].a != t.a || triangles[i].b != t.b || triangles[i].c != t.c) return false;
+    }
+    return true;
+  }
+}
+
+TriangleBasis::TriangleBasis(const Point2f (&src)[Triangle::NUM_VERTICES])
+{
+  this->srcRect = boundingRect(Mat(Triangle::NUM_VERTICES, 1, CV_32FC2, (void*)src));
+
+  // Vertices relative to the bounding rect, as the source is cropped to it
+  double x[3], y[3];
+  for (int i=0; i<3; i++)
+  {
+    x[i] = src[i].x - this->srcRect.x;
+    y[i] = src[i].y - this->srcRect.y;
+  }
+
+  // Adjugate of [x; y; 1] over its determinant
+  double det = x[0]*(y[1] - y[2]) - x[1]*(y[0] - y[2]) + x[2]*(y[0] - y[1]);
+  this->degenerate = abs(det) < 1e-12;
+  if (this->degenerate)
+  {
+    fill(this->inv, this->inv + 9, 0.0);
+    return;
+  }
+  double k = 1.0/det;
+  double* m = this->inv;
+  m[0] = (y[1] - y[2])*k;  m[1] = (x[2] - x[1])*k;  m[2] = (x[1]*y[2] - x[2]*y[1])*k;
+  m[3] = (y[2] - y[0])*k;  m[4] = (x[0] - x[2])*k;  m[5] = (x[2]*y[0] - x[0]*y[2])*k;
+  m[6] = (y[0] - y[1])*k;  m[7] = (x[1] - x[0])*k;  m[8] = (x[0]*y[1] - x[1]*y[0])*k;
+}
+
+/**
+ * Affine transformation (2x3, CV_64FC1) from the source triangle
+ * onto [dest], both relative to their bounding rects.
+ * A degenerate source maps everything to its first pixel,
+ * as [getAffineTransform] does.
+ */
+void TriangleBasis::affineTo(const Point2f (&dest)[Triangle::NUM_VERTICES], Mat& W) const
+{
+  W.create(2, 3, CV_64FC1);
+  double* wx = W.ptr<double>(0);
+  double* wy = W.ptr<double>(1);
+  for (int c=0; c<3; c++)
+  {
+    wx[c] = dest[0].x*inv[c] + dest[1].x*inv[3+c] + dest[2].x*inv[6+c];
+    wy[c] = dest[0].y*inv[c] + dest[1].y*inv[3+c] + dest[2].y*inv[6+c];
+  }
+}
+
+const TriangleBasis* TextureBasisCache::of(const vector<Texture>& textures)
+{
+  if (textures.empty()) return nullptr;
+  const Mat& vertices = *textures[0].vertexRef;
+  for (auto& entry : this->entries)
+  {
+    if (sameTriangles(entry.triangles, textures) && sameVertices(entry.vertices, vertices))
+    {
+      TRACE_COUNT("texture.basis.hits", 1);
+      return entry.bases.data();
+    }
+  }
+
+  TRACE_COUNT("texture.basis.builds", 1);
+  Entry* entry;
+  if (this->entries.size() < CAPACITY)
+  {
+    this->entries.push_back(Entry());
+    entry = &this->entries.back();
+  }
+  else
+  {
+    // Round robin once the cache is full
+    entry = &this->entries[this->next];
+    this->next = (this->next + 1) % CAPACITY;
+  }
+  vertices.copyTo(entry->vertices);
+  entry->triangles.clear();
+  entry->bases.clear();
+  for (auto& texture : textures)
+  {
+    assert(texture.vertexRef == textures[0].vertexRef);
+    Point2f src[Triangle::NUM_VERTICES];
+    texture.bound.toArray(src, vertices);
+    entry->triangles.push_back(texture.bound);
+    entry->bases.push_back(TriangleBasis(src));
+  }
+  return entry->bases.data();
+}
+
 void Texture::save(const string path) const
 {
 
@@ -12,110 +141,125 @@ void Texture::load(const string path)
 
 Mat Texture::render(IO::GenericIO* io, Mat background, bool withVertices, bool withEdges, double scaleFactor, Point2d recentre) const
 {
-  assert(this->vertexRef != nullptr);
+  if (IO::isHeadless(io)) return background;
+
   Mat canvas = background.clone();
+  this->renderInto(canvas, withVertices, withEdges);
+  io->render(canvas);
+  return canvas;
+}
+
+/**
+ * Draw the texture over [canvas] in place.
+ * Only the bounding rect of the triangle is masked and copied.
+ */
+void Texture::renderInto(Mat& canvas, bool withVertices, bool withEdges) const
+{
+  assert(this->vertexRef != nullptr);
   double a,b,c,d;
   this->bound.boundary(*this->vertexRef,a,b,c,d);
-  const vector<Point2d> vertices = this->bound.toVector(*this->vertexRef);
+  Point2d vertices[Triangle::NUM_VERTICES];
+  this->bound.toArray(vertices, *this->vertexRef);
 
-  Rect boundary((int)floor(a), (int)floor(b), (int)ceil(c), (int)ceil(d));
+  // Inclusive of the pixels under the right and bottom vertices
+  Rect boundary((int)floor(a), (int)floor(b), (int)ceil(c) - (int)floor(a) + 1, (int)ceil(d) - (int)floor(b) + 1);
+  Rect visible = boundary & Rect(0, 0, min(canvas.cols, img->cols), min(canvas.rows, img->rows));
+  if (visible.area() > 0)
+  {
+    MatArena& arena = MatArena::local();
+    MatArena::Scope scope(arena);
 
-  // Draw the masking region
-  auto triangle = new Point[3];
-  this->bound.toIntArray(triangle,*this->vertexRef);
-  Mat mask = Mat::zeros(boundary.height, boundary.width, CV_8UC1);
-  const int counters[] = {3};
-  const Point* triangles[] = {&triangle[0], &triangle[0]+3};
-  fillPoly(mask, triangles, counters, 1, Scalar(255), LINE_8);
+    // Draw the masking region, relative to the visible rect
+    Point triangle[Triangle::NUM_VERTICES];
+    this->bound.toArray(triangle, *this->vertexRef);
+    for (auto& p : triangle) p -= visible.tl();
+    Mat mask = arena.zeros(visible.size(), CV_8UC1);
+    const int counters[] = {3};
+    const Point* triangles[] = {&triangle[0], &triangle[0]+3};
+    fillPoly(mask, triangles, counters, 1, Scalar(255), LINE_8);
 
-  for (int i=boundary.x; i<boundary.x + boundary.width; i++)
-    for (int j=boundary.y; j<boundary.y + boundary.height; j++)
-    {
-      if (i>=0 && i<min(canvas.cols, img->cols) &&
-          j>=0 && j<min(canvas.rows, img->rows) &&
-          i<mask.cols && j<mask.rows &&
-          mask.at<unsigned char>(j,i) > 0)
-      {
-        canvas.at<Vec3b>(j,i) = this->img->at<Vec3b>(j,i);
-      }
-    }
+    // A grayscale texture is drawn in colour onto a colour background
+    Mat src = toChannels((*this->img)(visible), canvas.channels());
+    Mat dest = canvas(visible);
+    dispatchChannels<CopyMasked>(canvas.channels(), src, mask, dest, Point(0, 0));
+  }
 
   if (withEdges) Draw::drawTriangle(canvas, vertices[0], vertices[1], vertices[2], Scalar(0,235,200));
-  if (withVertices) Draw::drawSpots(canvas, vertices, Scalar(0,255,220));
-
-  delete[] triangle;
-
-  io->render(canvas);
-  return canvas;
+  if (withVertices) Draw::drawSpots(canvas, vector<Point2d>(vertices, vertices + Triangle::NUM_VERTICES), Scalar(0,255,220));
 }
 
 /**
  * Piece-wise affine transformation.
  * Warping the texture to a new triangular boundary.
+ * [basis] of the source triangle may come from a [TextureBasisCache].
+ * With [clip], only the pixels of [dest] inside it are warped and written,
+ * so disjoint clips of the same [dest] can be filled concurrently.
  */
-Texture Texture::realignTo(const Triangle &newBound, Mat* newVertexRef, Mat* dest) const
+Texture Texture::realignTo(const Triangle &newBound, Mat* newVertexRef, Mat* dest, const TriangleBasis* basis, const Rect* clip) const
 {
   assert(this->img->type() == dest->type());
-  double minX, minY, maxX, maxY;
-  newBound.boundary(*newVertexRef,minX, minY, maxX, maxY);
 
-  Mat R( 2, 3, CV_64FC1 );
-  auto srcTriangle  = this->bound.toFloatVector(*this->vertexRef);
-  auto destTriangle = newBound.toFloatVector(*newVertexRef);
-  Rect srcRect      = boundingRect(srcTriangle);
-  Rect destRect     = boundingRect(destTriangle);
-  Size srcSize      = Size(srcRect.width, srcRect.height);
-  Size destSize     = Size(destRect.width, destRect.height);
+  Point2f destTriangle[Triangle::NUM_VERTICES];
+  newBound.toArray(destTriangle, *newVertexRef);
+  Rect destRect     = boundingRect(Mat(Triangle::NUM_VERTICES, 1, CV_32FC2, destTriangle));
+  Rect target       = (clip == nullptr) ? destRect : (destRect & *clip);
+  if (target.area() == 0) return Texture(newBound, newVertexRef, dest);
+  TRACE_SCOPE("Texture::realignTo");
+  TRACE_COUNT("texture.warps", 1);
+
+  // The basis of the source triangle is built here unless precomputed
+  TriangleBasis localBasis;
+  if (basis == nullptr)
+  {
+    Point2f srcTriangle[Triangle::NUM_VERTICES];
+    this->bound.toArray(srcTriangle, *this->vertexRef);
+    localBasis = TriangleBasis(srcTriangle);
+    basis = &localBasis;
+  }
+
+  Rect srcRect      = basis->srcRect;
 
   // Make sure the ROI is not exceeding the size of the image
   srcRect.width = max(min(srcRect.width, this->img->cols - srcRect.x), 0);
   srcRect.height = max(min(srcRect.height, this->img->rows - srcRect.y), 0);
 
-  // Crop the source by the bounding rectangle
-  Mat im = *this->img;
-  Mat imgSrc = Mat(srcSize, this->img->type());
-  Mat imgDest = Mat::zeros(destSize, this->img->type());
-  im(srcRect).copyTo(imgSrc);
+  // Crop the source by the bounding rectangle,
+  // the warp does not read outside of the view
+  MatArena& arena = MatArena::local();
+  MatArena::Scope scope(arena);
+  Mat imgSrc = (*this->img)(srcRect);
+  Mat imgDest = arena.acquire(target.size(), this->img->type());
 
-  // Offset the triangles by left corner
-  vector<Point2f> offsetSrcTriangle;
-  vector<Point2f> offsetDestTriangle;
-  Point* triangle = new Point[3]; // For convex drawing
-  for (int i=0; i<3; i++)
+  // Offset the destination triangle by its left corner,
+  // the mask is drawn relative to the (clipped) target
+  Point shift = target.tl() - destRect.tl();
+  Point2f offsetDestTriangle[Triangle::NUM_VERTICES];
+  Point triangle[Triangle::NUM_VERTICES]; // For convex drawing
+  for (int i=0; i<Triangle::NUM_VERTICES; i++)
   {
-    auto pSrc  = srcTriangle[i];
     auto pDest = destTriangle[i];
     double xDest = pDest.x - destRect.x;
     double yDest = pDest.y - destRect.y;
-    offsetSrcTriangle.push_back(Point2f(pSrc.x - srcRect.x, pSrc.y - srcRect.y));
-    offsetDestTriangle.push_back(Point2f(xDest, yDest));
-    triangle[i] = Point((int)xDest, (int)yDest);
+    offsetDestTriangle[i] = Point2f(xDest, yDest);
+    triangle[i] = Point((int)xDest, (int)yDest) - shift;
   }
 
-  // Apply affine transformation on the offset triangles
-  Mat W = getAffineTransform(offsetSrcTriangle, offsetDestTriangle);
+  // Apply affine transformation on the offset triangles,
+  // translated so the output starts at the target. warpAffine rounds
+  // in fixed point, so a clipped warp may differ by 1 from the unclipped one
+  Mat W;
+  basis->affineTo(offsetDestTriangle, W);
+  W.at<double>(0,2) -= shift.x;
+  W.at<double>(1,2) -= shift.y;
   warpAffine(imgSrc, imgDest, W, imgDest.size(), INTER_LINEAR);
 
   // Draw a triangular mask (for the target)
-  Mat mask = Mat::zeros(destSize, CV_8UC1);
+  Mat mask = arena.zeros(target.size(), CV_8UC1);
   const int counters[] = {3};
   const Point* triangles[] = {&triangle[0], &triangle[0]+3};
   fillPoly(mask, triangles, counters, 1, Scalar(255), LINE_8);
 
   // Clone pixels inside the mask to the output canvas
-  for (int x=0; x<destSize.width; x++)
-    for (int y=0; y<destSize.height; y++)
-    {
-      if (mask.at<unsigned char>(y,x) > 0 && 
-        x >= 0 && x < imgDest.cols &&
-        y >= 0 && y < imgDest.rows &&
-        x+destRect.x >= 0 && x+destRect.x < dest->cols &&
-        y+destRect.y >= 0 && y+destRect.y < dest->rows)
-      {
-        dest->at<Vec3b>(y+destRect.y, x+destRect.x) = imgDest.at<Vec3b>(y,x);
-      }
-    }
-
-  delete[] triangle;
+  dispatchChannels<CopyMasked>(dest->channels(), imgDest, mask, *dest, target.tl());
   return Texture(newBound, newVertexRef, dest);
 }
\ No newline at end of file
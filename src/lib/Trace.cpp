@@ -0,0 +1,235 @@
+#include "Trace.h"
+
+namespace Trace
+{
+  std::atomic<bool> enabled(false);
+
+  /**
+   * Complete event of Chrome trace format ("ph":"X")
+   */
+  struct Event
+  {
+    const char* name;
+    double tsUs;
+    double durUs;
+    int tid;
+  };
+
+  /**
+   * Records of a single thread, keyed by the literal names.
+   * Only its own thread writes to it, the lock is taken by the
+   * merge as well so it is never contended on the hot path.
+   */
+  struct ThreadLog
+  {
+    std::mutex lock;
+    int tid;
+    unordered_map<const char*, TimerStat> timers;
+    unordered_map<const char*, long long> counters;
+    vector<Event> events;
+  };
+
+  struct Registry
+  {
+    std::mutex lock;
+    vector<shared_ptr<ThreadLog>> logs; // Kept after their threads exit
+    std::atomic<size_t> maxEvents{1000000}; // Per thread
+    std::atomic<Clock::rep> origin{Clock::now().time_since_epoch().count()};
+  };
+
+  static Registry& registry()
+  {
+    static Registry r;
+    return r;
+  }
+
+  /**
+   * Log of the calling thread, registered on first use
+   */
+  static ThreadLog& local()
+  {
+    static thread_local shared_ptr<ThreadLog> log;
+    if (log == nullptr)
+    {
+      auto& r = registry();
+      log = make_shared<ThreadLog>();
+      std::lock_guard<std::mutex> guard(r.lock);
+      log->tid = (int)r.logs.size();
+      r.logs.push_back(log);
+    }
+    return *log;
+  }
+
+  void enable(bool on, size_t maxEvents)
+  {
+    registry().maxEvents.store(maxEvents);
+    enabled.store(on);
+  }
+
+  void reset()
+  {
+    auto& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (auto& log : r.logs)
+    {
+      std::lock_guard<std::mutex> logGuard(log->lock);
+      log->timers.clear();
+      log->counters.clear();
+      log->events.clear();
+    }
+    r.origin.store(Clock::now().time_since_epoch().count());
+  }
+
+  void count(const char* name, long long n)
+  {
+    auto& log = local();
+    std::lock_guard<std::mutex> guard(log.lock);
+    log.counters[name] += n;
+  }
+
+  void record(const char* name, Clock::time_point start, Clock::time_point end)
+  {
+    double ms = chrono::duration<double, milli>(end - start).count();
+    auto& r = registry();
+    auto& log = local();
+    std::lock_guard<std::mutex> guard(log.lock);
+
+    auto it = log.timers.find(name);
+    if (it == log.timers.end())
+      log.timers[name] = TimerStat{ 1, ms, ms, ms };
+    else
+    {
+      auto& stat = it->second;
+      stat.count++;
+      stat.totalMs += ms;
+      stat.minMs = min(stat.minMs, ms);
+      stat.maxMs = max(stat.maxMs, ms);
+    }
+
+    if (log.events.size() < r.maxEvents.load(std::memory_order_relaxed))
+    {
+      Clock::time_point origin{Clock::duration(r.origin.load(std::memory_order_relaxed))};
+      double ts = chrono::duration<double, micro>(start - origin).count();
+      log.events.push_back(Event{ name, ts, ms * 1000.0, log.tid });
+    }
+  }
+
+  map<string, TimerStat> timers()
+  {
+    // The same name may come from several threads and literals
+    map<string, TimerStat> merged;
+    auto& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (auto& log : r.logs)
+    {
+      std::lock_guard<std::mutex> logGuard(log->lock);
+      for (auto& kv : log->timers)
+      {
+        auto it = merged.find(kv.first);
+        if (it == merged.end())
+          merged[kv.first] = kv.second;
+        else
+        {
+          auto& stat = it->second;
+          stat.count += kv.second.count;
+          stat.totalMs += kv.second.totalMs;
+          stat.minMs = min(stat.minMs, kv.second.minMs);
+          stat.maxMs = max(stat.maxMs, kv.second.maxMs);
+        }
+      }
+    }
+    return merged;
+  }
+
+  map<string, long long> counters()
+  {
+    map<string, long long> merged;
+    auto& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (auto& log : r.logs)
+    {
+      std::lock_guard<std::mutex> logGuard(log->lock);
+      for (auto& kv : log->counters)
+        merged[kv.first] += kv.second;
+    }
+    return merged;
+  }
+
+  static vector<Event> events()
+  {
+    vector<Event> merged;
+    auto& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (auto& log : r.logs)
+    {
+      std::lock_guard<std::mutex> logGuard(log->lock);
+      merged.insert(merged.end(), log->events.begin(), log->events.end());
+    }
+    return merged;
+  }
+
+  string toJSON()
+  {
+    auto t = timers();
+    auto c = counters();
+    string out = "{\n  \"timers\": {";
+    bool first = true;
+    for (auto& kv : t)
+    {
+      out += fmt::format("{0}\n    \"{1}\": {{\"count\": {2}, \"totalMs\": {3:.6f}, \"meanMs\": {4:.6f}, \"minMs\": {5:.6f}, \"maxMs\": {6:.6f}}}",
+        first ? "" : ",", kv.first, kv.second.count, kv.second.totalMs,
+        kv.second.totalMs / kv.second.count, kv.second.minMs, kv.second.maxMs);
+      first = false;
+    }
+    out += "\n  },\n  \"counters\": {";
+    first = true;
+    for (auto& kv : c)
+    {
+      out += fmt::format("{0}\n    \"{1}\": {2}", first ? "" : ",", kv.first, kv.second);
+      first = false;
+    }
+    out += "\n  }\n}\n";
+    return out;
+  }
+
+  string toChromeTrace()
+  {
+    auto e = events();
+    auto c = counters();
+    string out = "{\"traceEvents\": [";
+    bool first = true;
+    for (auto& ev : e)
+    {
+      out += fmt::format("{0}\n{{\"name\": \"{1}\", \"ph\": \"X\", \"ts\": {2:.3f}, \"dur\": {3:.3f}, \"pid\": 1, \"tid\": {4}}}",
+        first ? "" : ",", ev.name, ev.tsUs, ev.durUs, ev.tid);
+      first = false;
+    }
+    for (auto& kv : c)
+    {
+      out += fmt::format("{0}\n{{\"name\": \"{1}\", \"ph\": \"C\", \"ts\": 0, \"pid\": 1, \"args\": {{\"value\": {2}}}}}",
+        first ? "" : ",", kv.first, kv.second);
+      first = false;
+    }
+    out += "\n], \"displayTimeUnit\": \"ms\"}\n";
+    return out;
+  }
+
+  static bool writeFile(const string& path, const string& content)
+  {
+    FILE* f = fopen(path.c_str(), "w");
+    if (f == nullptr) return false;
+    fputs(content.c_str(), f);
+    fclose(f);
+    return true;
+  }
+
+  bool saveJSON(const string& path)
+  {
+    return writeFile(path, toJSON());
+  }
+
+  bool saveChromeTrace(const string& path)
+  {
+    return writeFile(path, toChromeTrace());
+  }
+}
@@ -30,20 +30,12 @@ ostream &operator<<(ostream &os, Triangle const &m)
 
 void Triangle::boundary(const Mat& m, double& minX, double& minY, double& maxX, double& maxY) const
 {
-  minX = numeric_limits<double>::max();
-  minY = numeric_limits<double>::max();
-  maxY = -numeric_limits<double>::max();
-  maxX = -numeric_limits<double>::max();
-  int vx[3] = {a, b, c};
-  for (int i=0; i<3; i++)
-  {
-    double x = m.at<double>(vx[i],0);
-    double y = m.at<double>(vx[i],1);
-    minX = x < minX ? x : minX;
-    minY = y < minY ? y : minY;
-    maxX = x > maxX ? x : maxX;
-    maxY = y > maxY ? y : maxY;
-  }
+  Point2d p[NUM_VERTICES];
+  this->toArray(p, m);
+  minX = min(p[0].x, min(p[1].x, p[2].x));
+  minY = min(p[0].y, min(p[1].y, p[2].y));
+  maxX = max(p[0].x, max(p[1].x, p[2].x));
+  maxY = max(p[0].y, max(p[1].y, p[2].y));
 }
 
 Rect Triangle::boundingRect(const Mat& mat) const
@@ -55,29 +47,17 @@ Rect Triangle::boundingRect(const Mat& mat) const
 
 vector<Point2f> Triangle::toFloatVector(const Mat& mat) const
 {
-  vector<Point2f> v;
-  int vx[3] = {a, b, c};
-  for (int i=0; i<3; i++)
-  {
-    // Enforce double => float implication
-    float x = mat.at<double>(vx[i],0);
-    float y = mat.at<double>(vx[i],1);
-    v.push_back(Point2f(x, y));
-  }
-  return v;
+  // Enforce double => float implication
+  Point2f p[NUM_VERTICES];
+  this->toArray(p, mat);
+  return vector<Point2f>(p, p + NUM_VERTICES);
 }
 
 vector<Point2d> Triangle::toVector(const Mat& mat) const
 {
-  vector<Point2d> v;
-  int vx[3] = {a, b, c};
-  for (int i=0; i<3; i++)
-  {
-    double x = mat.at<double>(vx[i],0);
-    double y = mat.at<double>(vx[i],1);
-    v.push_back(Point2d(x, y));
-  }
-  return v;
+  Point2d p[NUM_VERTICES];
+  this->toArray(p, mat);
+  return vector<Point2d>(p, p + NUM_VERTICES);
 }
 
 void Triangle::toIntArray(Point* p, const Mat& mat) const
@@ -85,7 +65,8 @@ void Triangle::toIntArray(Point* p, const Mat& mat) const
   int vx[3] = {a, b, c};
   for (int i=0; i<3; i++)
   {
-    p[i].x = (int)mat.at<double>(vx[i],0);
-    p[i].y = (int)mat.at<double>(vx[i],1);
+    const double* row = mat.ptr<double>(vx[i]);
+    p[i].x = (int)row[0];
+    p[i].y = (int)row[1];
   }
-}
\ No newline at end of file
+}
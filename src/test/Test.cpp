@@ -1,5 +1,9 @@
 #include "Test.h"
 
+#ifdef NDEBUG
+#error "The tests rely on assert, build them without NDEBUG"
+#endif
+
 struct F
 { 
   string s; 
@@ -8,6 +12,18 @@ struct F
 
 template class PriorityLinkedList<F>;
 
+/**
+ * Localiser with predefined detections
+ */
+class FixedFaceLocaliser : public FaceLocaliser
+{
+private:
+  vector<Rect> faces;
+public:
+  FixedFaceLocaliser(const vector<Rect>& faces) : FaceLocaliser(), faces(faces) {};
+  vector<Rect> find(Mat im) const { return this->faces; };
+};
+
 void testPriorityList()
 {
   PriorityLinkedList<F> ls;
@@ -25,7 +41,442 @@ void testPriorityList()
   ls.push(e, 450);  ls.printValueList("Adding 450 : ");
   ls.push(f, 240);  ls.printValueList("Adding 240 : ");
   ls.push(g, 550);  ls.printValueList("Adding 550 : ");
-  ls.take(4);       ls.printValueList("Taking 4   : ");
+  vector<unique_ptr<F>> dropped;
+  ls.take(4, &dropped); ls.printValueList("Taking 4   : ");
+  assert(ls.size() == 4);
+  assert(dropped.size() == 3);
+  assert(ls.valueAt(1) == 30);
+  assert(ls.valueAt(10) == numeric_limits<double>::max());
+  ls.clear(&dropped);
+  assert(ls.size() == 0);
+  assert(dropped.size() == 7);
+}
+
+void testMatArena()
+{
+  MatArena arena;
+  unsigned char* first;
+  {
+    MatArena::Scope scope(arena);
+    Mat a = arena.zeros(32, 32, CV_8UC3);
+    Mat b = arena.acquire(1, 16, CV_64FC1);
+    first = a.data;
+    assert(countNonZero(a.reshape(1)) == 0);
+    assert(a.data != b.data);
+  }
+  assert(arena.inUse() == 0);
+
+  // Same request after the scope ends should recycle the buffer
+  {
+    MatArena::Scope scope(arena);
+    Mat a = arena.acquire(16, 16, CV_8UC3);
+    assert(a.data == first);
+  }
+  cout << "MatArena : " << arena.numBuffers() << " buffers pooled" << endl;
+}
+
+void testStepScheduler()
+{
+  auto policy = StepPolicy::getDefault();
+  StepScheduler scheduler(policy);
+  assert(scheduler.step(RESHAPING) == policy.maxStep);
+
+  // Rarely improving candidates shrink the step of that action only
+  scheduler.record(RESHAPING, 100, 0);
+  scheduler.adapt(RESHAPING);
+  assert(scheduler.step(RESHAPING) < policy.maxStep);
+  assert(scheduler.step(REAPPEARANCING) == policy.maxStep);
+
+  // A stalled action is eventually exhausted
+  int n = 0;
+  while (scheduler.shrink(SCALING)) n++;
+  assert(scheduler.step(SCALING) <= policy.minStep);
+  cout << "StepScheduler : SCALING exhausted after " << n << " shrinks" << endl;
+}
+
+void testHeadlessRender()
+{
+  IO::NullIO io;
+  auto mesh = initialMesh(16);
+  Mat canvas = Mat::zeros(CANVAS_SIZE, CANVAS_SIZE, CV_8UC3);
+  Mat out = mesh.render(&io, canvas);
+
+  // Nothing should be drawn nor copied
+  assert(out.data == canvas.data);
+  assert(countNonZero(canvas.reshape(1)) == 0);
+  cout << "Headless rendering : no drawing done" << endl;
+
+  // Drawing all triangles at once matches drawing them one by one
+  IO::MatIO mio;
+  Appearance app(mesh, chessPattern(5, Size(CANVAS_SIZE, CANVAS_SIZE)));
+  Mat chained = canvas;
+  for (auto& texture : app.getTextures()) chained = texture.render(&mio, chained, false, false);
+  Mat single = app.render(&mio, canvas, false, false);
+  assert(norm(single, chained, NORM_INF) == 0);
+  assert(countNonZero(canvas.reshape(1)) == 0);
+
+  // Reference masking each triangle over the whole canvas,
+  // so no pixel outside of the triangles may be drawn
+  Mat reference = canvas.clone();
+  auto shape = app.getShape();
+  for (auto& triangle : shape.getTriangles())
+  {
+    Point vertices[Triangle::NUM_VERTICES];
+    triangle.toArray(vertices, shape.mat);
+    Mat mask = Mat::zeros(reference.size(), CV_8UC1);
+    const int counters[] = {3};
+    const Point* triangles[] = {&vertices[0], &vertices[0]+3};
+    fillPoly(mask, triangles, counters, 1, Scalar(255), LINE_8);
+    app.getGraphic().copyTo(reference, mask);
+  }
+  assert(norm(single, reference, NORM_INF) == 0);
+  cout << "Appearance rendering : single pass over the triangles" << endl;
+}
+
+void testTrace()
+{
+  Trace::reset();
+  Trace::enable();
+  for (int i=0; i<3; i++)
+  {
+    TRACE_SCOPE("test.scope");
+    TRACE_COUNT("test.counter", 2);
+  }
+  // Records of every thread are merged on export
+  vector<std::thread> threads;
+  for (int t=0; t<4; t++)
+    threads.emplace_back([]()
+    {
+      TRACE_SCOPE("test.scope");
+      TRACE_COUNT("test.counter", 1);
+    });
+  for (auto& t : threads) t.join();
+  Trace::enable(false);
+  TRACE_COUNT("test.counter", 100); // Ignored while disabled
+
+  auto timers = Trace::timers();
+  auto counters = Trace::counters();
+  assert(timers["test.scope"].count == 7);
+  assert(counters["test.counter"] == 10);
+  assert(Trace::toJSON().find("\"test.scope\"") != string::npos);
+  assert(Trace::toChromeTrace().find("\"ph\": \"X\"") != string::npos);
+  Trace::reset();
+  cout << "Trace : timers and counters recorded" << endl;
+}
+
+void testRandom()
+{
+  Random::seed(42);
+  Mat a = Aux::randomMat(Size(8, 1), 0, 5);
+  double u = Random::uniform();
+  Random::seed(42);
+  Mat b = Aux::randomMat(Size(8, 1), 0, 5);
+  assert(norm(a, b, NORM_INF) == 0);
+  assert(Random::uniform() == u);
+
+  // Generated meshes only depend on the seed
+  auto m1 = initialMesh(12, 7);
+  auto m2 = initialMesh(12, 7);
+  assert(norm(m1.getMat(), m2.getMat(), NORM_INF) == 0);
+  cout << "Random : sequences reproduced from the seed" << endl;
+}
+
+void testShapeSet()
+{
+  // Generic landmark count, then the specialised face topology
+  for (int numPoints : {6, 68})
+  {
+    auto trainset = initialShapeCollection(8, numPoints, 3);
+    auto items    = trainset->getItems();
+    ShapeSet set(items);
+    assert(norm(set.toMat(), trainset->toMat(), NORM_INF) == 0);
+
+    // Batch normalisation matches the per-shape recipe
+    set.normaliseScalingTranslation();
+    for (int i=0; i<set.size(); i++)
+    {
+      auto shape    = dynamic_cast<Shape*>(items[i]);
+      auto centroid = shape->centroid();
+      auto cdist    = shape->sumSquareDistanceToPoint(centroid);
+      Shape expected = (*shape << centroid) * (1.0/cdist);
+      Shape actual;
+      set.toShape(i, actual);
+      assert(norm(expected.getMat(), actual.getMat(), NORM_INF) < 1e-12);
+    }
+
+    // Rotation towards the first shape does not increase the distance to it
+    Shape base;
+    set.toShape(0, base);
+    double before = set.sumProcrustesDistance(base);
+    set.normaliseRotation();
+    assert(set.sumProcrustesDistance(base) <= before + 1e-12);
+  }
+  cout << "ShapeSet : batch normalisation matches Shape" << endl;
+
+  auto trainset = initialShapeCollection(8, 6, 3);
+  // Copies own their items, transforms stay in place
+  ShapeCollection copied(*trainset);
+  copied.translateBy(Point2d(5, -5));
+  assert(copied.at(0) != trainset->at(0));
+  assert(abs(norm(copied.toMat(), trainset->toMat(), NORM_INF) - 5) < 1e-9);
+  // Alignment on the packed set matches the generic per-step one
+  ShapeCollection generic(copied);
+  auto mean = copied.procrustesMean();
+  auto genericMean = generic.ModelCollection::procrustesMean();
+  assert(mean.get() != copied.at(0));
+  assert(norm(mean->getMat(), genericMean->getMat(), NORM_INF) < 1e-12);
+  assert(norm(copied.toMat(), generic.toMat(), NORM_INF) < 1e-12);
+  copied.clear();
+  assert(copied.size() == 0);
+  cout << "ShapeCollection : copies and transforms own their items" << endl;
+}
+
+void testReferenceFrame()
+{
+  auto aamCollection = initialAppearanceCollection(6, 6, 5, false);
+  auto shapeCollection = aamCollection->toShapeCollection();
+  auto meanShapeModel = shapeCollection->procrustesMean();
+
+  ReferenceFrame frame(*dynamic_cast<Shape*>(meanShapeModel.get()), 64);
+  assert(frame.getSize().width == 64);
+  assert(frame.numPixels() == countNonZero(frame.getMask()));
+
+  // Vectors only hold the in-mesh pixels, and spread back onto them
+  Mat data = aamCollection->toMat(frame);
+  assert(data.rows == aamCollection->size() && data.cols == frame.dimension());
+  Scalar s = sum(frame.toGraphic(data.row(0)));
+  assert(s[0] + s[1] + s[2] == sum(data.row(0))[0]);
+
+  unique_ptr<AppearanceModelPCA> pcaAppearance{ dynamic_cast<AppearanceModelPCA*>(aamCollection->pca(frame)) };
+  assert(pcaAppearance->hasFrame());
+  Mat param = pcaAppearance->toParam(aamCollection->at(0));
+  unique_ptr<Appearance> encoded{ pcaAppearance->toAppearance(param) };
+  assert(encoded->getShape().mat.rows == frame.getShape().mat.rows);
+  cout << "ReferenceFrame : " << frame.dimension() << " elements per appearance vector" << endl;
+}
+
+void testPhotometric()
+{
+  // Gain and bias recovered in closed form
+  GainBiasFit fit;
+  for (int i=0; i<20; i++) fit.add(2.0*i + 5, i);
+  assert(abs(fit.gain() - 2) < 1e-9 && abs(fit.bias() - 5) < 1e-9);
+  assert(fit.residual() < 1e-6);
+
+  // Two samples differing by brightness and contrast only
+  Mat data = Aux::randomMat(Size(12, 2), 100, 30);
+  data.row(1) = data.row(0) * 0.5 + 40;
+  for (auto mode : {PHOTOMETRIC_GLOBAL, PHOTOMETRIC_PER_CHANNEL})
+  {
+    PhotometricNormaliser photometric(mode);
+    Mat normalised = data.clone();
+    photometric.train(normalised);
+    photometric.normalise(normalised.row(0));
+    photometric.normalise(normalised.row(1));
+    assert(norm(normalised.row(0), normalised.row(1), NORM_INF) < 1e-9);
+  }
+  cout << "Photometric : brightness and contrast normalised" << endl;
+}
+
+void testGrayscale()
+{
+  auto aamCollection = initialAppearanceCollection(6, 6, 7, false, 1);
+  assert(aamCollection->channels() == 1);
+  auto shapeCollection = aamCollection->toShapeCollection();
+  auto meanShapeModel = shapeCollection->procrustesMean();
+
+  // Single-channel frame, vectors hold one value per pixel
+  ReferenceFrame frame(*dynamic_cast<Shape*>(meanShapeModel.get()), 48, 1);
+  Mat data = aamCollection->toMat(frame);
+  assert(data.cols == frame.numPixels());
+
+  unique_ptr<AppearanceModelPCA> pcaAppearance{ dynamic_cast<AppearanceModelPCA*>(aamCollection->pca(frame)) };
+  assert(pcaAppearance->getChannels() == 1);
+  Mat param = pcaAppearance->toParam(aamCollection->at(0));
+  unique_ptr<Appearance> encoded{ pcaAppearance->toAppearance(param) };
+  assert(encoded->channels() == 1);
+  cout << "Grayscale : " << frame.dimension() << " elements per appearance vector" << endl;
+
+  // Fitting a grayscale model onto a colour sample, which the fitter converts
+  const int SKIP_SIZE = 2;
+  unique_ptr<ShapeModelPCA> pcaShape{ dynamic_cast<ShapeModelPCA*>(
+    shapeCollection->pca(dynamic_cast<Shape*>(meanShapeModel.get()), -1)) };
+  unique_ptr<AAMPCA> aamPCA{ new AAMPCA(*pcaShape, *pcaAppearance) };
+  unique_ptr<BaseFittedModel> sampleModel{ new FittedAAM(aamPCA) };
+  sampleModel->setScale(0.9);
+  sampleModel->setOrigin(14, 16);
+  Size spanned = sampleModel->getSpannedSize();
+  Mat canvas = Mat::zeros(Size(spanned.width + 1, spanned.height + 1), CV_8UC1);
+  Mat graySample = sampleModel->drawOverlay(canvas);
+  Mat colourSample;
+  cvtColor(graySample, colourSample, COLOR_GRAY2BGR);
+
+  auto crit = FittingCriteria::getDefault();
+  crit.numMaxIter = 10;
+  crit.initScale = 1;
+  crit.initPos = Point2d(8, 8);
+  crit.minScale = 0.7;
+  crit.maxScale = 1.3;
+  crit.coarseSearch = true;
+  ModelFitter fitter(aamPCA, crit, colourSample);
+  unique_ptr<BaseFittedModel> initModel{ new FittedAAM(aamPCA) };
+  auto startModel = initModel->clone();
+  startModel->setOrigin(crit.initPos);
+  startModel->setScale(crit.initScale);
+  double initError = startModel->measureError(graySample, SKIP_SIZE);
+  auto fitted = fitter.fit(initModel, SKIP_SIZE);
+  double fittedError = fitted->measureError(graySample, SKIP_SIZE);
+  cout << "Grayscale fitting : " << initError << " ~> " << fittedError << endl;
+  assert(fittedError <= initError);
+}
+
+void testTriangleBasis()
+{
+  // Same transformation as solving for it from the vertices
+  Point2f src[] = { Point2f(3.5f, 1), Point2f(20, 4.25f), Point2f(8, 17) };
+  Point2f dest[] = { Point2f(0, 2), Point2f(15.5f, 0), Point2f(6, 12) };
+  TriangleBasis basis(src);
+  Point2f offsetSrc[3];
+  for (int i=0; i<3; i++) offsetSrc[i] = src[i] - Point2f(basis.srcRect.x, basis.srcRect.y);
+  Mat W;
+  basis.affineTo(dest, W);
+  assert(!basis.degenerate);
+  assert(norm(W, getAffineTransform(offsetSrc, dest), NORM_INF) < 1e-9);
+
+  // Reused until the source vertices move
+  Appearance app(initialMesh(6, 11), chessPattern(5, Size(CANVAS_SIZE, CANVAS_SIZE)));
+  auto textures = app.getTextures();
+  TextureBasisCache& cache = TextureBasisCache::local();
+  cache.clear();
+  const TriangleBasis* bases = cache.of(textures);
+  assert(cache.of(textures) == bases);
+  Mat moved = textures[0].vertexRef->clone();
+  moved.at<double>(0,0) += 1;
+  for (auto& texture : textures) texture.reassignVertexRef(&moved);
+  assert(cache.of(textures) != bases);
+  cout << "TriangleBasis : affine transformations reused per source mesh" << endl;
+}
+
+void testParallelWarp()
+{
+  // Banded warp against a sequential one over the whole canvas
+  auto base = initialMesh(12, 13);
+  Appearance app(base, chessPattern(5, Size(CANVAS_SIZE, CANVAS_SIZE)));
+  auto target = MeshShape(base);
+  target.addRandomNoise(Point2d(6.5, 6.5));
+
+  const int span = 16;
+  auto size = target.getSpannedSize();
+  Mat expected = Mat::zeros(size.height + span, size.width + span, CV_8UC3);
+  auto textures = app.getTextures();
+  auto targetTriangles = target.getTriangles();
+  for (int ti=0; ti<targetTriangles.size(); ti++)
+    textures[ti].realignTo(targetTriangles[ti], &target.mat, &expected);
+
+  app.realignTo(target);
+  assert(app.getGraphic().size() == expected.size());
+  // Each band rounds its translated warp on its own, allow 1 level of difference
+  assert(norm(app.getGraphic(), expected, NORM_INF) <= 1);
+  cout << "Appearance::realignTo : banded warp within 1 of sequential warp" << endl;
+}
+
+void testFrameFitting()
+{
+  const int SKIP_SIZE = 3;
+  auto aamCollection = initialAppearanceCollection(8, 6, 17, false);
+  auto shapeCollection = aamCollection->toShapeCollection();
+  auto meanShapeModel = shapeCollection->procrustesMean();
+  auto meanShape = dynamic_cast<Shape*>(meanShapeModel.get());
+
+  // Appearance trained on the mean-shape frame, at the resolution of the mean shape
+  MeshShape meanMeshShape(*meanShape);
+  ReferenceFrame frame(*meanShape, meanMeshShape.getBound().width);
+  unique_ptr<AppearanceModelPCA> pcaAppearance{ dynamic_cast<AppearanceModelPCA*>(aamCollection->pca(frame)) };
+  unique_ptr<ShapeModelPCA> pcaShape{ dynamic_cast<ShapeModelPCA*>(shapeCollection->pca(meanShape, -1)) };
+  unique_ptr<AAMPCA> aamPCA{ new AAMPCA(*pcaShape, *pcaAppearance) };
+  assert(pcaAppearance->getBound() == meanMeshShape.getBound());
+
+  // Sample generated by the frame-trained model
+  unique_ptr<BaseFittedModel> sampleModel{ new FittedAAM(aamPCA) };
+  sampleModel->setScale(0.9);
+  sampleModel->setOrigin(20, 24);
+  sampleModel->setAppearanceParam(Aux::randomMat(sampleModel->appearanceParam.size(), 0, 10));
+  unique_ptr<Appearance> sampleAppearance{ sampleModel->toAppearance() };
+  IO::MatIO ioSample;
+  sampleAppearance->render(&ioSample, Mat::zeros(sampleAppearance->getSpannedSize(), CV_8UC3), false, false);
+  Mat sampleMat = ioSample.get();
+
+  // The generating model explains its own rendering
+  double e0;
+  double eSelf = sampleModel->measureError(sampleMat, SKIP_SIZE, numeric_limits<double>::max(), &e0);
+  assert(eSelf < e0);
+
+  // Fitting from a displaced start never ends worse than it started
+  auto crit = FittingCriteria::getDefault();
+  crit.numMaxIter = 20;
+  crit.initScale = 1;
+  crit.initPos = Point2d(12, 12);
+  crit.minScale = 0.7;
+  crit.maxScale = 1.5;
+  ModelFitter fitter(aamPCA, crit, sampleMat);
+  unique_ptr<BaseFittedModel> initModel{ new FittedAAM(aamPCA) };
+  auto startModel = initModel->clone();
+  startModel->setOrigin(crit.initPos);
+  startModel->setScale(crit.initScale);
+  double initError = startModel->measureError(sampleMat, SKIP_SIZE);
+  auto fitted = fitter.fit(initModel, SKIP_SIZE);
+  double fittedError = fitted->measureError(sampleMat, SKIP_SIZE);
+  assert(fittedError <= initError);
+  cout << "Frame-trained fitting : " << initError << " ~> " << fittedError
+    << " (self " << eSelf << ")" << endl;
+}
+
+void testPhotometricError()
+{
+  const int SKIP_SIZE = 1;
+  auto aamCollection = initialAppearanceCollection(8, 6, 19, false);
+  aamCollection->setPhotometric(PHOTOMETRIC_GLOBAL);
+  auto shapeCollection = aamCollection->toShapeCollection();
+  auto meanShapeModel = shapeCollection->procrustesMean();
+  auto meanShape = dynamic_cast<Shape*>(meanShapeModel.get());
+
+  ReferenceFrame frame(*meanShape, MeshShape(*meanShape).getBound().width);
+  unique_ptr<AppearanceModelPCA> pcaAppearance{ dynamic_cast<AppearanceModelPCA*>(aamCollection->pca(frame)) };
+  unique_ptr<ShapeModelPCA> pcaShape{ dynamic_cast<ShapeModelPCA*>(shapeCollection->pca(meanShape, -1)) };
+  unique_ptr<AAMPCA> aamPCA{ new AAMPCA(*pcaShape, *pcaAppearance) };
+  assert(pcaAppearance->getPhotometric().isEnabled());
+
+  unique_ptr<BaseFittedModel> model{ new FittedAAM(aamPCA) };
+  model->setScale(0.9);
+  model->setOrigin(10, 12);
+  model->setAppearanceParam(Aux::randomMat(model->appearanceParam.size(), 0, 10));
+  Size spanned = model->getSpannedSize();
+  spanned = Size(spanned.width + 1, spanned.height + 1);
+
+  // The model itself under a known gain and bias
+  Mat canvas = Mat::zeros(spanned, CV_8UC3);
+  Mat overlay = model->drawOverlay(canvas);
+  Mat sample;
+  overlay.convertTo(sample, -1, 0.8, 20);
+  double e0;
+  double e = model->measureError(sample, SKIP_SIZE, numeric_limits<double>::max(), &e0);
+  cout << "Photometric error under gain and bias : " << e << " (flat sample " << e0 << ")" << endl;
+  assert(e < 1);
+  assert(e0 > e);
+
+  // Another appearance, the partial residual bounds the full one from below
+  unique_ptr<BaseFittedModel> other = model->clone();
+  other->setAppearanceParam(Aux::randomMat(model->appearanceParam.size(), 0, 40));
+  Mat otherCanvas = Mat::zeros(spanned, CV_8UC3);
+  Mat otherSample = other->drawOverlay(otherCanvas);
+  double eFull = model->measureError(otherSample, SKIP_SIZE);
+  double eRejected = model->measureError(otherSample, SKIP_SIZE, eFull / 2);
+  assert(eRejected > eFull / 2 && eRejected <= eFull + 1e-9);
+
+  // Early rejection above the error does not change it
+  assert(model->measureError(otherSample, SKIP_SIZE, eFull * 2) == eFull);
+  assert(model->measureError(sample, SKIP_SIZE, e + 1) == e);
+  cout << "Photometric error : early rejection agrees with full measurement" << endl;
 }
 
 void testMeshShape(char** argv)
@@ -85,7 +536,7 @@ void testShape(char** argv)
   auto ioMean = IO::WindowIO("mean", Point(CANVAS_SIZE+10, CANVAS_SIZE+25));
   
   // Re-scale and re-centre the mean shape before rendering
-  Shape* meanShape = dynamic_cast<Shape*>(meanModel);
+  Shape* meanShape = dynamic_cast<Shape*>(meanModel.get());
   meanShape->recentreAndScale(Point2d(CANVAS_HALFSIZE, CANVAS_HALFSIZE), Aux::square(CANVAS_HALFSIZE));
   meanShape->render(&ioMean, Mat(CANVAS_SIZE, CANVAS_SIZE, CV_8UC3, Scalar(80,20,5)));
   
@@ -163,7 +614,8 @@ void testAAMCollection()
   auto aamCollectionResized = aamCollection->resizeTo(size);
 
   // Compute procrustes mean of the collection
-  auto meanAppearance = dynamic_cast<Appearance*>(aamCollectionResized->procrustesMean());
+  auto meanAppearanceModel = aamCollectionResized->procrustesMean();
+  auto meanAppearance = dynamic_cast<Appearance*>(meanAppearanceModel.get());
   auto ioMean = IO::WindowIO("mean");
   meanAppearance->render(&ioMean, Mat::zeros(CANVAS_SIZE, CANVAS_SIZE, CV_8UC3));
   moveWindow("mean", CANVAS_SIZE + 10, 0);
@@ -329,8 +781,10 @@ void testAAMFitting()
   auto shapeCollection = aamCollection->toShapeCollection();
   
   // Find means
-  auto meanAppearance = dynamic_cast<Appearance*>(aamCollection->procrustesMean());
-  auto meanShape = dynamic_cast<Shape*>(shapeCollection->procrustesMean());
+  auto meanAppearanceModel = aamCollection->procrustesMean();
+  auto meanShapeModel = shapeCollection->procrustesMean();
+  auto meanAppearance = dynamic_cast<Appearance*>(meanAppearanceModel.get());
+  auto meanShape = dynamic_cast<Shape*>(meanShapeModel.get());
   auto meanMeshShape = MeshShape(*meanShape);
 
   IO::WindowIO ioMean("meanApp");
@@ -356,6 +810,13 @@ void testAAMFitting()
 
   // Generate unknown sample out of the trained PCA
   unique_ptr<AAMPCA> aamPCA{ new AAMPCA(*pcaShape, *pcaAppearance) };
+
+  // Joint shape + appearance model over the training samples
+  Mat shapeParams, appearanceParams;
+  for (auto m : shapeCollection->getItems()) shapeParams.push_back(pcaShape->toParam(m));
+  for (auto m : aamCollection->getItems()) appearanceParams.push_back(pcaAppearance->toParam(m));
+  aamPCA->trainCombined(shapeParams, appearanceParams);
+  cout << "PCA dimension of combined   : " << aamPCA->dimensionCombined() << endl;
   unique_ptr<BaseFittedModel> sampleModel{ new FittedAAM(aamPCA) };
   Mat initShapeParam = Aux::randomMat(sampleModel->shapeParam.size(), 0, 5.5);
   Mat initAppParam = Aux::randomMat(sampleModel->appearanceParam.size(), 0, 25);
@@ -387,11 +848,15 @@ void testAAMFitting()
   const int SKIP_SIZE = 3;
   double initError = numeric_limits<double>::max();
   Point2d initCentre(10, 10);
-  auto crit = FittingCriteria { 
-    maxIters, maxTreeSize, 
-    numModelsToGeneratePerIter, 
-    minImprovement, initScale, initCentre,
-    minScale, maxScale };
+  auto crit = FittingCriteria::getDefault();
+  crit.numMaxIter = maxIters;
+  crit.maxTreeSize = maxTreeSize;
+  crit.numModelsToGeneratePerIter = numModelsToGeneratePerIter;
+  crit.minErrorImprovement = minImprovement;
+  crit.initScale = initScale;
+  crit.initPos = initCentre;
+  crit.minScale = minScale;
+  crit.maxScale = maxScale;
   
   unique_ptr<ModelFitter> fitter{ new ModelFitter(
     aamPCA,
@@ -433,17 +898,116 @@ void testAAMFitting()
   alignedAAM->render(&ioAligned, Mat::zeros(sizeAligned, CV_8UC3), false, true);
   Mat alignedMat = ioAligned.get();
   Rect alignedBound = alignedModel->getBound();
+
+  // The search region covers the beam, as far as the sample goes
+  Rect visibleBound = alignedBound & Rect(0, 0, sampleMat.cols, sampleMat.rows);
+  assert((visibleBound & fitter->getROI()) == visibleBound);
   imshow("aligned", alignedMat);
   moveWindow("aligned", CANVAS_SIZE*2 + sizeSample.width, CANVAS_SIZE);
   waitKey(5000);
+
+  // The error measured over a region containing the model
+  // is the same as over the whole sample
+  Rect around = Rect(alignedBound.x - 1, alignedBound.y - 1, alignedBound.width + 2, alignedBound.height + 2)
+    & Rect(0, 0, sampleMat.cols, sampleMat.rows);
+  double eWhole = alignedModel->measureError(sampleMat, SKIP_SIZE);
+  double eRegion = alignedModel->measureError(sampleMat(around), SKIP_SIZE);
+  cout << "Error over the whole sample : " << eWhole << ", over " << around << " : " << eRegion << endl;
+  assert(abs(eWhole - eRegion) < 1e-9);
+
+  // Early rejection only saves time, the search takes the same course
+  StepScheduler withRejection = fitter->getScheduler();
+  auto noRejectionCrit = crit;
+  noRejectionCrit.earlyRejection = false;
+  fitter->setCriteria(noRejectionCrit);
+  auto noRejectionModel = fitter->fit(initModel, SKIP_SIZE);
+  for (int i=0; i<NUM_SEARCH_ACTIONS; i++)
+  {
+    SearchWith action = static_cast<SearchWith>(i);
+    assert(fitter->getScheduler().accepted(action) == withRejection.accepted(action));
+  }
+  assert(noRejectionModel->measureError(sampleMat, SKIP_SIZE) == eWhole);
+  fitter->setCriteria(crit);
+  cout << "Early rejection : same acceptance with and without" << endl;
+
+  // Joint search in the combined space never ends worse than it started
+  cout << GREEN << "AAM model fitting with combined search started ..." << RESET << endl;
+  auto combinedCrit = crit;
+  combinedCrit.combinedSearch = true;
+  combinedCrit.numMaxIter = 4 * maxIters; // Room to reach the combined action
+  fitter->setCriteria(combinedCrit);
+  auto combinedInit = initModel->clone();
+  combinedInit->setOrigin(combinedCrit.initPos);
+  combinedInit->setScale(combinedCrit.initScale);
+  double combinedInitError = combinedInit->measureError(sampleMat, SKIP_SIZE);
+  auto combinedModel = fitter->fit(initModel, SKIP_SIZE);
+  double combinedError = combinedModel->measureError(sampleMat, SKIP_SIZE);
+  cout << "Combined search error : " << combinedInitError << " ~> " << combinedError << endl;
+  assert(fitter->getScheduler().evaluated(COMBINED) > 0);
+  assert(combinedError <= combinedInitError);
+  fitter->setCriteria(crit);
+
+  // Same fitting, initialised by the coarse global search
+  cout << GREEN << "AAM model fitting with coarse search started ..." << RESET << endl;
+  auto coarseCrit = crit;
+  coarseCrit.coarseSearch = true;
+
+  // Without any iteration, the fit returns the coarse placement alone,
+  // which lands near the generating model, within one scale of the grid
+  auto placementCrit = coarseCrit;
+  placementCrit.numMaxIter = 0;
+  fitter->setCriteria(placementCrit);
+  auto placedModel = fitter->fit(initModel, SKIP_SIZE);
+  double scaleStep = pow(coarseCrit.maxScale / coarseCrit.minScale, 1.0 / (coarseCrit.coarseScaleSteps - 1));
+  cout << "Coarse placement : " << placedModel->origin << " scale = " << placedModel->scale << endl;
+  assert(norm(placedModel->origin - sampleModel->origin) <= 5);
+  assert(abs(log(placedModel->scale / sampleModel->scale)) <= log(scaleStep));
+
+  fitter->setCriteria(coarseCrit);
+  auto coarseModel = fitter->fit(initModel, SKIP_SIZE);
+  cout << "Coordinate  : " << coarseModel->origin << endl;
+  cout << "Scale       : " << coarseModel->scale << endl;
+  assert(coarseModel->measureError(sampleMat, SKIP_SIZE) <= placedModel->measureError(sampleMat, SKIP_SIZE));
+  fitter->setCriteria(crit);
+
+  // Multi-start fitting, seeded by a detection on the sample and a decoy
+  cout << GREEN << "Detection seeded AAM model fitting started ..." << RESET << endl;
+  FixedFaceLocaliser localiser({ sampleBound, Rect(0, 0, sampleBound.width, sampleBound.height) });
+  AAM2D aam(&localiser, aamPCA, crit, SKIP_SIZE);
+  auto seeded = aam.seedFromDetection(sampleBound);
+  cout << "Seeded from detection : " << seeded.initPos << " scale = " << seeded.initScale << endl;
+  auto fittedModels = aam.fit(sampleMat);
+  assert(fittedModels.size() == 2);
+  for (auto& m : fittedModels)
+    cout << "Fitted at " << m->origin << " scale = " << m->scale << endl;
+
+  // Fits come in the order of detections, the true face beats the decoy
+  double seededError = fittedModels[0]->measureError(sampleMat, SKIP_SIZE);
+  double decoyError = fittedModels[1]->measureError(sampleMat, SKIP_SIZE);
+  cout << "Seeded error : " << seededError << ", decoy error : " << decoyError << endl;
+  assert(seededError < decoyError);
 }
 
 int main(int argc, char** argv)
 {
   signal(SIGSEGV, segFaultHandler);
   adjustStackSize();
+  Log::setLevel(Log::Debug);
 
   testPriorityList();
+  testMatArena();
+  testStepScheduler();
+  testHeadlessRender();
+  testTrace();
+  testRandom();
+  testShapeSet();
+  testReferenceFrame();
+  testPhotometric();
+  testGrayscale();
+  testTriangleBasis();
+  testParallelWarp();
+  testFrameFitting();
+  testPhotometricError();
 
   // cout << MAGENTA << "**********************" << RESET << endl;
   // cout << MAGENTA << " Mesh shape testing  "  << RESET << endl;